@@ -8,9 +8,10 @@
 #include "src/cvar.h"
 #include "src/flog.h"
 #include "src/zone.h"
+#include "src/profiler.h"
 #include <meshoptimizer.h>
 
-#define number_of_queues 1 // <- change this if more queues needed
+#define number_of_queues 3 // <- graphics, async compute, transfer. Shared families are merged.
 
 /* {
 GVAR: window_width -> window.cpp
@@ -21,6 +22,7 @@ GVAR: AcquiredSemaphore -> window.cpp
 GVAR: ReadySemaphore -> window.cpp
 GVAR: compute_queue_family_index -> window.cpp
 GVAR: graphics_queue_family_index -> window.cpp
+GVAR: transfer_queue_family_index -> window.cpp
 GVAR: instance -> startup.cpp
 GVAR: Fence_one -> window.cpp
 GVAR: memory_properties -> control.cpp
@@ -50,6 +52,7 @@ int main(int argc, char *lpCmdLine[])
 
 	static const char *device_extensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 	struct QueueInfo QueueInfos[number_of_queues];
+	int queue_count = 0;
 	WindowParameters windowParams;
 	float priority[] = {0.0f};
 	static VkImageUsageFlags desired_usages = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |  VK_IMAGE_USAGE_TRANSFER_DST_BIT;
@@ -89,15 +92,29 @@ int main(int argc, char *lpCmdLine[])
 	    !startup::CheckPhysicalDevices() ||
 	    !startup::CheckPhysicalDeviceExtensions()||
 	    !startup::CheckQueueProperties(VK_QUEUE_GRAPHICS_BIT, graphics_queue_family_index )||
-	    //  !startup::CheckQueueProperties(VK_QUEUE_COMPUTE_BIT, compute_queue_family_index)||
 	    !surface::CreatePresentationSurface(windowParams)||
 	    !surface::CheckSurfaceQueueSupport(graphics_queue_family_index)||
-	    //!surface::CheckSurfaceQueueSupport(compute_queue_family_index)||
 	    !surface::CheckSelectPresentationModesSupport(VK_PRESENT_MODE_MAILBOX_KHR)||
-	    !surface::CheckPresentationSurfaceCapabilities()||
-	    !startup::SetQueue(QueueInfos, graphics_queue_family_index, priority, 0)||
-	    // !startup::SetQueue(QueueInfos, compute_queue_family_index, priority, 1)||
-	    !startup::CreateLogicalDevice(QueueInfos, number_of_queues, 1, device_extensions)||
+	    !surface::CheckPresentationSurfaceCapabilities())
+	{
+		startup::debug_pause();
+		exit(1);
+	}
+
+	//prefer dedicated families, otherwise the work just shares the graphics queue.
+	if(!startup::CheckQueueProperties(VK_QUEUE_COMPUTE_BIT, compute_queue_family_index, VK_QUEUE_GRAPHICS_BIT))
+		compute_queue_family_index = graphics_queue_family_index;
+	if(!startup::CheckQueueProperties(VK_QUEUE_TRANSFER_BIT, transfer_queue_family_index, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+		transfer_queue_family_index = graphics_queue_family_index;
+
+	startup::SetQueue(QueueInfos, graphics_queue_family_index, priority, queue_count++);
+	if(compute_queue_family_index != graphics_queue_family_index)
+		startup::SetQueue(QueueInfos, compute_queue_family_index, priority, queue_count++);
+	if(transfer_queue_family_index != graphics_queue_family_index && transfer_queue_family_index != compute_queue_family_index)
+		startup::SetQueue(QueueInfos, transfer_queue_family_index, priority, queue_count++);
+
+	if(
+	    !startup::CreateLogicalDevice(QueueInfos, queue_count, 1, device_extensions)||
 	    !startup::LoadDeviceLevelFunctions())
 	{
 		startup::debug_pause();
@@ -105,7 +122,9 @@ int main(int argc, char *lpCmdLine[])
 	}
 
 	vkGetDeviceQueue(logical_device, graphics_queue_family_index, 0, &GraphicsQueue);
-	//vkGetDeviceQueue(logical_device, compute_queue_family_index, 0, &ComputeQueue);
+	vkGetDeviceQueue(logical_device, compute_queue_family_index, 0, &ComputeQueue);
+	vkGetDeviceQueue(logical_device, transfer_queue_family_index, 0, &TransferQueue);
+	info("Queue families: graphics %u, compute %u, transfer %u", graphics_queue_family_index, compute_queue_family_index, transfer_queue_family_index);
 
 	trace("Vulkan Initialized Successfully! \n");
 
@@ -131,7 +150,8 @@ int main(int argc, char *lpCmdLine[])
 	    !control::CreateFence(Fence_one, VK_FENCE_CREATE_SIGNALED_BIT)||
 	    !control::CreateCommandPools(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, graphics_queue_family_index, NUM_COMMAND_BUFFERS)||
 	    !control::AllocatePrimaryCommandBuffers(NUM_COMMAND_BUFFERS)||
-	    !control::AllocateSecondaryCommandBuffers(NUM_COMMAND_BUFFERS)
+	    !control::AllocateSecondaryCommandBuffers(NUM_COMMAND_BUFFERS)||
+	    !control::CreateComputeCommandBuffer(compute_queue_family_index)
 	)
 	{
 		startup::debug_pause();
@@ -152,7 +172,7 @@ int main(int argc, char *lpCmdLine[])
 	window::PreDraw();
 
 #ifdef DEBUG
-	startup::CreateQueryPool(128);
+	startup::CreateQueryPool(GPU_PROFILER_QUERIES);
 	p("Startup time: %f", glfwGetTime()-init);
 #endif
 
@@ -0,0 +1,50 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(local_size_x = 64) in; //CULL_GROUP_SIZE
+
+struct CullInput
+{
+	vec4 sphere; //world center, radius.
+	mat4 model;
+	uint mesh;
+};
+
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout(push_constant) uniform PushConsts {
+	vec4 planes[6]; //normals point inwards.
+	uint count;
+} push_constants;
+
+layout(std430, set = 0, binding = 0) readonly buffer Inputs { CullInput inputs[]; };
+layout(std430, set = 0, binding = 1) buffer Draws { DrawCommand draws[]; };
+layout(std430, set = 0, binding = 2) writeonly buffer Instances { mat4 models[]; };
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if(i >= push_constants.count)
+	{
+		return;
+	}
+
+	CullInput e = inputs[i];
+	for(int p = 0; p < 6; p++)
+	{
+		if(dot(push_constants.planes[p].xyz, e.sphere.xyz) + push_constants.planes[p].w < -e.sphere.w)
+		{
+			return;
+		}
+	}
+
+	uint slot = draws[e.mesh].firstInstance + atomicAdd(draws[e.mesh].instanceCount, 1);
+	models[slot] = e.model;
+}
@@ -10,7 +10,7 @@ layout(set = 2, binding = 0) uniform sampler2D texSampler;
 
 void main()
 {
-	//when we execute the texture, fc.r should be used, when just normal rects fragColor.a should be used.
+	//glyphs and icons are signed distance fields with the edge at 0.5, plain rects just use fragColor.a.
 	vec4 afc;
 	if(fragTexCoord.x > 1.0)
 	{
@@ -18,8 +18,10 @@ void main()
 	}
 	else
 	{
-		vec4 fc = texture(texSampler, fragTexCoord);
-		afc = vec4(fragColor.r, fragColor.g, fragColor.b, fc.r) * fragColor.a;	 
+		float dist = texture(texSampler, fragTexCoord).r;
+		float width = max(fwidth(dist), 0.0001);
+		float coverage = smoothstep(0.5 - width, 0.5 + width, dist);
+		afc = vec4(fragColor.r, fragColor.g, fragColor.b, coverage) * fragColor.a;
 	}
 	
 	outColor = afc;	     	 
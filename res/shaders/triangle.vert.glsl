@@ -16,13 +16,14 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inTexCoord;
 layout(location = 2) in vec3 inColor;
+layout(location = 3) in mat4 inModel; //binding 1, advances per gl_InstanceIndex.
 
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 0) out vec3 fragColor;
 
 void main()
 {    
-    gl_Position = push_constants.mvp * ubo.model * ubo.view * ubo.proj * vec4(inPosition, 1.0);
+    gl_Position = push_constants.mvp * inModel * ubo.model * ubo.view * ubo.proj * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
 }
@@ -2,6 +2,7 @@
 #include "window.h"
 #include "zone.h"
 #include "flog.h"
+#include "profiler.h"
 
 /* {
 GVAR: logical_device -> startup.cpp
@@ -12,11 +13,14 @@ GVAR: allocators -> startup.cpp
 //{
 thread_local VkCommandBuffer command_buffer;
 VkCommandBuffer *scommand_buffers = nullptr;
+VkCommandBuffer compute_command_buffer = VK_NULL_HANDLE;
+VkSemaphore ComputeSemaphore = VK_NULL_HANDLE;
 VkPhysicalDeviceMemoryProperties memory_properties;
 VkDescriptorPool descriptor_pool;
 VkDescriptorSetLayout vubo_dsl;
 VkDescriptorSetLayout fubo_dsl;
 VkDescriptorSetLayout tex_dsl;
+VkDescriptorSetLayout sbo_dsl;
 vram_heap texmgr_heaps[TEXTURE_MAX_HEAPS];
 dynbuffer_t dyn_index_buffers[NUM_DYNAMIC_BUFFERS];
 dynbuffer_t dyn_vertex_buffers[NUM_DYNAMIC_BUFFERS];
@@ -35,6 +39,28 @@ static VkDeviceMemory dyn_vertex_buffer_memory;
 static VkDeviceMemory dyn_uniform_buffer_memory;
 static VkDeviceMemory	staging_memory;
 static VkDescriptorSet	ubo_descriptor_sets[NUM_DYNAMIC_BUFFERS];
+static VkCommandPool compute_command_pool = VK_NULL_HANDLE;
+static VkFence compute_fence = VK_NULL_HANDLE;
+static bool compute_submitted = false;
+
+typedef struct
+{
+	uint8_t		type;
+	uint64_t	frame;
+	union
+	{
+		VkSwapchainKHR	swapchain;
+		VkImageView		view;
+		VkFramebuffer	framebuffer;
+		VkImage			image;
+		VkDeviceMemory	memory;
+		VkBuffer		buffer;
+	};
+} retired_t;
+
+static retired_t retired[MAX_RETIRED_RESOURCES];
+static int retired_count = 0;
+static uint64_t completed_frames = 0;
 
 namespace control
 {
@@ -178,18 +204,20 @@ void BeginCommandBufferRecordingOperation(VkCommandBufferUsageFlags usage, VkCom
 
 void CreateDescriptorPool()
 {
-	VkDescriptorPoolSize pool_sizes[2];
+	VkDescriptorPoolSize pool_sizes[3];
 	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	pool_sizes[0].descriptorCount = 32;
 	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	pool_sizes[1].descriptorCount = 2048;
+	pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes[2].descriptorCount = 8;
 
 	VkDescriptorPoolCreateInfo descriptor_pool_create_info;
 	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descriptor_pool_create_info.pNext = nullptr;
 	descriptor_pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 	descriptor_pool_create_info.maxSets = 2048 + 32;
-	descriptor_pool_create_info.poolSizeCount = 2;
+	descriptor_pool_create_info.poolSizeCount = ARRAYSIZE(pool_sizes);
 	descriptor_pool_create_info.pPoolSizes = pool_sizes;
 	VK_CHECK(vkCreateDescriptorPool(logical_device, &descriptor_pool_create_info, allocators, &descriptor_pool));
 }
@@ -242,6 +270,17 @@ void CreateDescriptorSetLayouts()
 	slb.pImmutableSamplers = nullptr;
 	slb.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
+	//sbo = storage buffer objects, compute input, indirect commands and instances.
+	VkDescriptorSetLayoutBinding sbo[3];
+	for(uint32_t i = 0; i<ARRAYSIZE(sbo); i++)
+	{
+		sbo[i].binding = i;
+		sbo[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		sbo[i].descriptorCount = 1;
+		sbo[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		sbo[i].pImmutableSamplers = nullptr;
+	}
+
 	//dslci = descriptor set layout create info
 	VkDescriptorSetLayoutCreateInfo dslci;
 	dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -255,6 +294,9 @@ void CreateDescriptorSetLayouts()
 	VK_CHECK(vkCreateDescriptorSetLayout(logical_device, &dslci, allocators, &tex_dsl));
 	dslci.pBindings = &fubo;
 	VK_CHECK(vkCreateDescriptorSetLayout(logical_device, &dslci, allocators, &fubo_dsl));
+	dslci.bindingCount = ARRAYSIZE(sbo);
+	dslci.pBindings = &sbo[0];
+	VK_CHECK(vkCreateDescriptorSetLayout(logical_device, &dslci, allocators, &sbo_dsl));
 }
 
 bool ResetCommandBuffer(bool release_resources)
@@ -646,6 +688,7 @@ void DestroyUniformBuffers()
 	vkDestroyDescriptorSetLayout(logical_device, vubo_dsl, allocators);
 	vkDestroyDescriptorSetLayout(logical_device, tex_dsl, allocators);
 	vkDestroyDescriptorSetLayout(logical_device, fubo_dsl, allocators);
+	vkDestroyDescriptorSetLayout(logical_device, sbo_dsl, allocators);
 	vkFreeMemory(logical_device, dyn_uniform_buffer_memory, allocators);
 	vkDestroyDescriptorPool(logical_device, descriptor_pool, allocators);
 }
@@ -661,6 +704,7 @@ They are used to map the vertex data to vram.
 
 void ResetStagingBuffer()
 {
+	CPU_SCOPE("ResetStagingBuffer");
 	VkResult err;
 	current_staging_buffer--;
 	stagingbuffer_t* staging_buffer = &staging_buffers[current_staging_buffer];
@@ -925,4 +969,228 @@ void VertexBuffersAllocate()
 		dyn_vertex_buffers[i].data = (unsigned char *)data + (i * aligned_size);
 }
 
+/*
+==============================================================================
+
+					DEFERRED DESTRUCTION
+
+Resources that may still be referenced by an in-flight frame are retired
+instead of destroyed. They are freed once enough frame fences have signaled
+since their retirement. Main thread only.
+==============================================================================
+*/
+
+enum
+{
+	RETIRED_SWAPCHAIN,
+	RETIRED_IMAGE_VIEW,
+	RETIRED_FRAMEBUFFER,
+	RETIRED_IMAGE,
+	RETIRED_MEMORY,
+	RETIRED_BUFFER
+};
+
+static void DestroyRetiredResource(retired_t* r)
+{
+	switch(r->type)
+	{
+	case RETIRED_SWAPCHAIN:
+		vkDestroySwapchainKHR(logical_device, r->swapchain, nullptr);
+		break;
+	case RETIRED_IMAGE_VIEW:
+		vkDestroyImageView(logical_device, r->view, nullptr);
+		break;
+	case RETIRED_FRAMEBUFFER:
+		vkDestroyFramebuffer(logical_device, r->framebuffer, nullptr);
+		break;
+	case RETIRED_IMAGE:
+		vkDestroyImage(logical_device, r->image, nullptr);
+		break;
+	case RETIRED_MEMORY:
+		vkFreeMemory(logical_device, r->memory, nullptr);
+		break;
+	case RETIRED_BUFFER:
+		vkDestroyBuffer(logical_device, r->buffer, nullptr);
+		break;
+	}
+}
+
+static retired_t* RetireSlot(uint8_t type)
+{
+	if(retired_count == MAX_RETIRED_RESOURCES)
+	{
+		//should not happen, fall back to a full drain.
+		warn("Retire queue is full, waiting for device idle.");
+		VK_CHECK(vkDeviceWaitIdle(logical_device));
+		DestroyRetired();
+	}
+	retired_t* r = &retired[retired_count++];
+	r->type = type;
+	r->frame = completed_frames;
+	return r;
+}
+
+void RetireSwapchain(VkSwapchainKHR swapchain)
+{
+	if(swapchain == VK_NULL_HANDLE)
+		return;
+	RetireSlot(RETIRED_SWAPCHAIN)->swapchain = swapchain;
+}
+
+void RetireImageView(VkImageView view)
+{
+	if(view == VK_NULL_HANDLE)
+		return;
+	RetireSlot(RETIRED_IMAGE_VIEW)->view = view;
+}
+
+void RetireFramebuffer(VkFramebuffer framebuffer)
+{
+	if(framebuffer == VK_NULL_HANDLE)
+		return;
+	RetireSlot(RETIRED_FRAMEBUFFER)->framebuffer = framebuffer;
+}
+
+void RetireImage(VkImage image)
+{
+	if(image == VK_NULL_HANDLE)
+		return;
+	RetireSlot(RETIRED_IMAGE)->image = image;
+}
+
+void RetireMemory(VkDeviceMemory memory)
+{
+	if(memory == VK_NULL_HANDLE)
+		return;
+	RetireSlot(RETIRED_MEMORY)->memory = memory;
+}
+
+void RetireBuffer(VkBuffer buffer)
+{
+	if(buffer == VK_NULL_HANDLE)
+		return;
+	RetireSlot(RETIRED_BUFFER)->buffer = buffer;
+}
+
+//Call once per frame, after the frame fence was waited on.
+void CollectRetired()
+{
+	completed_frames++;
+	int j = 0;
+	for(int i = 0; i<retired_count; i++)
+	{
+		if(completed_frames - retired[i].frame >= RETIRE_FRAME_LATENCY)
+		{
+			DestroyRetiredResource(&retired[i]);
+			continue;
+		}
+		retired[j++] = retired[i];
+	}
+	retired_count = j;
+}
+
+//Device must be idle.
+void DestroyRetired()
+{
+	for(int i = 0; i<retired_count; i++)
+	{
+		DestroyRetiredResource(&retired[i]);
+	}
+	retired_count = 0;
+}
+
+/*
+==============================================================================
+
+					COMPUTE QUEUE
+
+Work recorded between BeginCompute and SubmitCompute runs on ComputeQueue,
+which is a dedicated family when the hardware has one. The next graphics
+submission waits on ComputeSemaphore, so compute can overlap with whatever
+the graphics queue is still doing from the previous frame.
+Buffers shared across different families need VK_SHARING_MODE_CONCURRENT
+or a queue family ownership barrier.
+==============================================================================
+*/
+
+bool CreateComputeCommandBuffer(uint32_t queue_family)
+{
+	VkCommandPoolCreateInfo command_pool_create_info =
+	{
+		VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,   // VkStructureType              sType
+		nullptr,                                      // const void                 * pNext
+		VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, // VkCommandPoolCreateFlags  flags
+		queue_family                                  // uint32_t                     queueFamilyIndex
+	};
+
+	VkResult result = vkCreateCommandPool(logical_device, &command_pool_create_info, allocators, &compute_command_pool);
+	if(result != VK_SUCCESS)
+	{
+		fatal("Could not create compute command pool.");
+		return false;
+	}
+
+	VkCommandBufferAllocateInfo command_buffer_allocate_info =
+	{
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,   // VkStructureType          sType
+		nullptr,                                          // const void             * pNext
+		compute_command_pool,                             // VkCommandPool            commandPool
+		VK_COMMAND_BUFFER_LEVEL_PRIMARY,                  // VkCommandBufferLevel     level
+		1                                                 // uint32_t                 commandBufferCount
+	};
+
+	result = vkAllocateCommandBuffers(logical_device, &command_buffer_allocate_info, &compute_command_buffer);
+	if(result != VK_SUCCESS)
+	{
+		fatal("Could not allocate compute command buffer.");
+		return false;
+	}
+
+	return CreateSemaphore(ComputeSemaphore) && CreateFence(compute_fence, VK_FENCE_CREATE_SIGNALED_BIT);
+}
+
+void BeginCompute()
+{
+	VK_CHECK(vkWaitForFences(logical_device, 1, &compute_fence, VK_TRUE, UINT64_MAX));
+	VK_CHECK(vkResetFences(logical_device, 1, &compute_fence));
+
+	VkCommandBufferBeginInfo command_buffer_begin_info;
+	memset(&command_buffer_begin_info, 0, sizeof(command_buffer_begin_info));
+	command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK_CHECK(vkBeginCommandBuffer(compute_command_buffer, &command_buffer_begin_info));
+}
+
+void SubmitCompute()
+{
+	VK_CHECK(vkEndCommandBuffer(compute_command_buffer));
+
+	VkSubmitInfo submit_info;
+	memset(&submit_info, 0, sizeof(submit_info));
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &compute_command_buffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &ComputeSemaphore;
+
+	VK_CHECK(vkQueueSubmit(ComputeQueue, 1, &submit_info, compute_fence));
+	compute_submitted = true;
+}
+
+//True once per SubmitCompute, the caller has to wait on ComputeSemaphore.
+bool ConsumeCompute()
+{
+	bool submitted = compute_submitted;
+	compute_submitted = false;
+	return submitted;
+}
+
+void DestroyCompute()
+{
+	vkDestroyFence(logical_device, compute_fence, allocators);
+	vkDestroySemaphore(logical_device, ComputeSemaphore, allocators);
+	vkFreeCommandBuffers(logical_device, compute_command_pool, 1, &compute_command_buffer);
+	vkDestroyCommandPool(logical_device, compute_command_pool, allocators);
+}
+
 } //namespace control
@@ -13,14 +13,19 @@
 #define NUM_STAGING_BUFFERS 5 //in actuality there are 2 staging as command buffer 0 is primary renderer.
 #define TEXTURE_MAX_HEAPS 5
 #define NUM_COMMAND_BUFFERS 5
+#define MAX_RETIRED_RESOURCES 64
+#define RETIRE_FRAME_LATENCY 2 //frames that have to complete before a retired resource is freed.
 
 extern thread_local VkCommandBuffer command_buffer;
 extern VkCommandBuffer *scommand_buffers;
+extern VkCommandBuffer compute_command_buffer;
+extern VkSemaphore ComputeSemaphore;
 extern VkPhysicalDeviceMemoryProperties	memory_properties;
 extern VkDescriptorPool descriptor_pool;
 extern VkDescriptorSetLayout vubo_dsl;
 extern VkDescriptorSetLayout fubo_dsl;
 extern VkDescriptorSetLayout tex_dsl;
+extern VkDescriptorSetLayout sbo_dsl;
 extern uint8_t current_cmd_buffer_index;
 extern int current_dyn_buffer_index;
 extern int current_staging_buffer;
@@ -99,6 +104,21 @@ void InvalidateDynamicBuffers();
 void SubmitStagingBuffer();
 void ResetStagingBuffer();
 
+void RetireSwapchain(VkSwapchainKHR swapchain);
+void RetireImageView(VkImageView view);
+void RetireFramebuffer(VkFramebuffer framebuffer);
+void RetireImage(VkImage image);
+void RetireMemory(VkDeviceMemory memory);
+void RetireBuffer(VkBuffer buffer);
+void CollectRetired();
+void DestroyRetired();
+
+bool CreateComputeCommandBuffer(uint32_t queue_family);
+void BeginCompute();
+void SubmitCompute();
+bool ConsumeCompute();
+void DestroyCompute();
+
 
 
 } //namespace control
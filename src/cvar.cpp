@@ -4,8 +4,31 @@
 #include "zone.h"
 #include "render.h"
 #include "flog.h"
+#include "profiler.h"
+#include "entity.h"
 
 cvar_t	wireframe = {"wireframe","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	gpu_trace_capture = {"gpu_trace_capture","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	cpu_trace_capture = {"cpu_trace_capture","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	ui_cache = {"ui_cache","1", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	cull = {"cull","1", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	gpu_cull = {"gpu_cull","1", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_threads = {"physics_threads","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_broadphase = {"physics_broadphase","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_dbvt_deferred = {"physics_dbvt_deferred","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_dbvt_prediction = {"physics_dbvt_prediction","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_snapshot = {"physics_snapshot","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_rollback = {"physics_rollback","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_profile = {"physics_profile","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_trace_capture = {"physics_trace_capture","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_hz = {"physics_hz","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_substeps = {"physics_substeps","4", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_record = {"physics_record","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_replay = {"physics_replay","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_lod = {"physics_lod","0", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_lod_near = {"physics_lod_near","40", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_lod_active = {"physics_lod_active","200", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
+cvar_t	physics_lod_sleep = {"physics_lod_sleep","4", CVAR_NONE, 0.0f, nullptr, 0, nullptr};
 
 static cvar_t	*cvar_vars;
 static char	cvar_null_string[] = "";
@@ -85,6 +108,40 @@ void Cvar_Init (void)
 {
 	Cvar_RegisterVariable (&wireframe);
 	Cvar_SetCallback(&wireframe, render::RebuildPipelines);
+	Cvar_RegisterVariable (&gpu_trace_capture);
+	Cvar_SetCallback(&gpu_trace_capture, profiler::GpuTraceCapture);
+	Cvar_RegisterVariable (&cpu_trace_capture);
+	Cvar_SetCallback(&cpu_trace_capture, profiler::CpuTraceCapture);
+	Cvar_RegisterVariable (&ui_cache);
+	Cvar_RegisterVariable (&cull);
+	Cvar_RegisterVariable (&gpu_cull);
+	Cvar_RegisterVariable (&physics_threads);
+	Cvar_SetCallback(&physics_threads, entity::PhysicsThreads);
+	Cvar_RegisterVariable (&physics_broadphase);
+	Cvar_SetCallback(&physics_broadphase, entity::PhysicsThreads);
+	Cvar_RegisterVariable (&physics_dbvt_deferred);
+	Cvar_SetCallback(&physics_dbvt_deferred, entity::TuneBroadphase);
+	Cvar_RegisterVariable (&physics_dbvt_prediction);
+	Cvar_SetCallback(&physics_dbvt_prediction, entity::TuneBroadphase);
+	Cvar_RegisterVariable (&physics_snapshot);
+	Cvar_SetCallback(&physics_snapshot, entity::Snapshot);
+	Cvar_RegisterVariable (&physics_rollback);
+	Cvar_SetCallback(&physics_rollback, entity::Rollback);
+	Cvar_RegisterVariable (&physics_profile);
+	Cvar_SetCallback(&physics_profile, entity::PhysicsProfile);
+	Cvar_RegisterVariable (&physics_trace_capture);
+	Cvar_SetCallback(&physics_trace_capture, profiler::PhysicsTraceCapture);
+	Cvar_RegisterVariable (&physics_hz);
+	Cvar_RegisterVariable (&physics_substeps);
+	Cvar_RegisterVariable (&physics_record);
+	Cvar_SetCallback(&physics_record, entity::PhysicsRecord);
+	Cvar_RegisterVariable (&physics_replay);
+	Cvar_SetCallback(&physics_replay, entity::PhysicsReplay);
+	Cvar_RegisterVariable (&physics_lod);
+	Cvar_SetCallback(&physics_lod, entity::PhysicsLod);
+	Cvar_RegisterVariable (&physics_lod_near);
+	Cvar_RegisterVariable (&physics_lod_active);
+	Cvar_RegisterVariable (&physics_lod_sleep);
 }
 
 //==============================================================================
@@ -92,6 +92,27 @@ typedef struct cvar_s
 
 //---------------------------   CVARS
 extern cvar_t	wireframe;
+extern cvar_t	gpu_trace_capture;
+extern cvar_t	cpu_trace_capture;
+extern cvar_t	ui_cache;
+extern cvar_t	cull;
+extern cvar_t	gpu_cull;
+extern cvar_t	physics_threads;
+extern cvar_t	physics_broadphase;
+extern cvar_t	physics_dbvt_deferred;
+extern cvar_t	physics_dbvt_prediction;
+extern cvar_t	physics_snapshot;
+extern cvar_t	physics_rollback;
+extern cvar_t	physics_profile;
+extern cvar_t	physics_trace_capture;
+extern cvar_t	physics_hz;
+extern cvar_t	physics_substeps;
+extern cvar_t	physics_record;
+extern cvar_t	physics_replay;
+extern cvar_t	physics_lod;
+extern cvar_t	physics_lod_near;
+extern cvar_t	physics_lod_active;
+extern cvar_t	physics_lod_sleep;
 //-----------------------------------
 
 void	Cvar_RegisterVariable (cvar_t *variable);
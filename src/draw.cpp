@@ -1,8 +1,11 @@
 #include "draw.h"
 #include "control.h"
 #include "textures.h"
-#include "atlas.h"
+#include "font.h"
 #include "flog.h"
+#include "cvar.h"
+#include "profiler.h"
+#include "gpucull.h"
 
 /* {
 GVAR: logical_device -> startup.cpp
@@ -12,6 +15,8 @@ GVAR: pipelines -> render.cpp
 GVAR: y_wheel = window.cpp;
 GVAR: time1 -> window.cpp
 GVAR: meshes -> entity.cpp
+GVAR: ents -> entity.cpp
+GVAR: ui_cache -> cvar.cpp
 } */
 
 static ui_ent_t ui;
@@ -73,6 +78,8 @@ void IndexedTriangle(size_t size, Vertex_* vertices, uint32_t index_count, uint3
 
 	zone::Q_memcpy(ent.vertex_data, &vertices[0], size);
 	vkCmdBindVertexBuffers(command_buffer, 0, 1, &ent.buffer[0], &ent.buffer_offset[0]);
+	VkDeviceSize identity_offset = instances.offset + INSTANCE_IDENTITY * sizeof(Matrix);
+	vkCmdBindVertexBuffers(command_buffer, 1, 1, &instances.buffer, &identity_offset);
 
 	zone::Q_memcpy(ent.index_data, index_array, index_count * sizeof(uint32_t));
 	vkCmdBindIndexBuffer(command_buffer, ent.buffer[1], ent.buffer_offset[1], VK_INDEX_TYPE_UINT32);
@@ -89,23 +96,44 @@ void IndexedTriangle(size_t size, Vertex_* vertices, uint32_t index_count, uint3
 }
 
 
-void Meshes()
+//Returns true when indirect draws were recorded, gpucull::Dispatch has to fill them this frame.
+bool Meshes()
 {
-	mesh_ent_t* head = meshes;
-	while(head->vertex_data != nullptr)
+	GPU_SCOPE("meshes");
+	//culling groups the visible instance matrices per mesh, every mesh is one instanced draw.
+	//with gpu_cull the commands are written by cull.comp.glsl, recording only depends on the mesh count.
+	bool indirect = gpu_cull.value && mesh_count;
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0]);
+	if(indirect)
 	{
-		btTransform transform; //update position
-		head->rigidBody->getMotionState()->getWorldTransform(transform);
-		btVector3 origin = transform.getOrigin();
-		TranslationMatrix(head->mat->model, origin.getX(), origin.getY(), origin.getZ());
-
-		vkCmdBindVertexBuffers(command_buffer, 0, 1, &head->buffer[0], &head->buffer_offset[0]);
-		vkCmdBindIndexBuffer(command_buffer, head->buffer[1], head->buffer_offset[1], VK_INDEX_TYPE_UINT32);
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0]);
-		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout[0], 0, 1, &head->dset[0], 1, &head->uniform_offset[0]);
-		vkCmdDrawIndexed(command_buffer, head->index_count, 1, 0, 0, 0);
-		head = head->next;
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(command_buffer, 1, 1, &cull_instance_buffer, &offset);
 	}
+	else
+	{
+		entity::CullEntities(cam.mvp);
+		vkCmdBindVertexBuffers(command_buffer, 1, 1, &instances.buffer, &instances.offset);
+	}
+	for(uint32_t i = 0; i<mesh_count; i++)
+	{
+		const mesh_t* mesh = &meshes[i];
+		if(!indirect && !mesh->instance_count)
+		{
+			continue;
+		}
+		vkCmdBindVertexBuffers(command_buffer, 0, 1, &mesh->buffer[0], &mesh->buffer_offset[0]);
+		vkCmdBindIndexBuffer(command_buffer, mesh->buffer[1], mesh->buffer_offset[1], VK_INDEX_TYPE_UINT32);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout[0], 0, 1, &mesh->dset, 1, &mesh->uniform_offset);
+		if(indirect)
+		{
+			vkCmdDrawIndexedIndirect(command_buffer, cull_draw_buffer, i * sizeof(VkDrawIndexedIndirectCommand), 1, 0);
+		}
+		else
+		{
+			vkCmdDrawIndexed(command_buffer, mesh->index_count, mesh->instance_count, 0, 0, mesh->first_instance);
+		}
+	}
+	return indirect;
 }
 
 void Line(vec3_t from, vec3_t to, vec3_t color, basic_ent_t& ent)
@@ -228,17 +256,7 @@ void CameraVectors()
 
 int r_get_text_width(const char *text, int len)
 {
-	int res = 0;
-	for (const char *p = text; *p && len--; p++)
-	{
-		if ((*p & 0xc0) == 0x80)
-		{
-			continue;
-		}
-		int chr = mu_min((unsigned char) *p, 127);
-		res += atlas[chr-27].w;
-	}
-	return res;
+	return font::TextWidth(font::Default(), text, len);
 }
 
 int text_width(mu_Font font, const char *text, int len)
@@ -247,135 +265,237 @@ int text_width(mu_Font font, const char *text, int len)
 	{
 		len = strlen(text);
 	}
-	return r_get_text_width(text, len);
+	return font::TextWidth(font ? (font_t*) font : font::Default(), text, len);
 }
 
 int text_height(mu_Font font)
 {
-	return 18;
+	return int((font ? (font_t*) font : font::Default())->size + 0.5f);
+}
+
+//Returns the 4 vertices of the next quad in this frame's ring region.
+static Uivertex* ui_quad()
+{
+	if(ui.buf_idx == ui.buffer_size)
+	{
+		//dropped for this frame, PrepareUI grows the ring before the next one.
+		ui.overflow = true;
+		return nullptr;
+	}
+	return (Uivertex*) ui.vertex_data + (ui.buf_idx++ * 4);
 }
 
 static void push_quad(mu_Rect dst, mu_Rect src, mu_Color color, bool tex)
 {
-	int texvert_idx = ui.buf_idx * 4;
-	int   index_idx = ui.buf_idx * 6;
-	ui.buf_idx++;
-	if(ui.buf_idx == ui.buffer_size-1)
+	Uivertex* vert = ui_quad();
+	if(!vert)
 	{
-		warn("Possibly out of ui memory!");
-		InitUI();
+		return;
 	}
-	Uivertex* vert = (Uivertex*) ui.vertex_data;
-	uint32_t* index_buf = ui.index_data;
 
-	vert[texvert_idx + 0].pos[0] = dst.x;
-	vert[texvert_idx + 0].pos[1] = dst.y;
+	vert[0].pos[0] = dst.x;
+	vert[0].pos[1] = dst.y;
 
-	vert[texvert_idx + 1].pos[0] = dst.x + dst.w;
-	vert[texvert_idx + 1].pos[1] = dst.y;
+	vert[1].pos[0] = dst.x + dst.w;
+	vert[1].pos[1] = dst.y;
 
-	vert[texvert_idx + 2].pos[0] = dst.x;
-	vert[texvert_idx + 2].pos[1] = dst.y + dst.h;
+	vert[2].pos[0] = dst.x;
+	vert[2].pos[1] = dst.y + dst.h;
 
-	vert[texvert_idx + 3].pos[0] = dst.x + dst.w;
-	vert[texvert_idx + 3].pos[1] = dst.y + dst.h;
+	vert[3].pos[0] = dst.x + dst.w;
+	vert[3].pos[1] = dst.y + dst.h;
 
 	if(tex)
 	{
 		/* update texture buffer */
-		float x = src.x / (float) ATLAS_WIDTH;
-		float y = src.y / (float) ATLAS_HEIGHT;
-		float w = src.w / (float) ATLAS_WIDTH;
-		float h = src.h / (float) ATLAS_HEIGHT;
-		vert[texvert_idx + 0].tex_coord[0] = x;
-		vert[texvert_idx + 0].tex_coord[1] = y;
-		vert[texvert_idx + 1].tex_coord[0] = x + w;
-		vert[texvert_idx + 1].tex_coord[1] = y;
-		vert[texvert_idx + 2].tex_coord[0] = x;
-		vert[texvert_idx + 2].tex_coord[1] = y + h;
-		vert[texvert_idx + 3].tex_coord[0] = x + w;
-		vert[texvert_idx + 3].tex_coord[1] = y + h;
+		float x = src.x / (float) FONT_ATLAS_WIDTH;
+		float y = src.y / (float) FONT_ATLAS_HEIGHT;
+		float w = src.w / (float) FONT_ATLAS_WIDTH;
+		float h = src.h / (float) FONT_ATLAS_HEIGHT;
+		vert[0].tex_coord[0] = x;
+		vert[0].tex_coord[1] = y;
+		vert[1].tex_coord[0] = x + w;
+		vert[1].tex_coord[1] = y;
+		vert[2].tex_coord[0] = x;
+		vert[2].tex_coord[1] = y + h;
+		vert[3].tex_coord[0] = x + w;
+		vert[3].tex_coord[1] = y + h;
 	}
 	else
 	{
-		vert[texvert_idx + 0].tex_coord[0] = FLT_MAX;
-		vert[texvert_idx + 1].tex_coord[0] = FLT_MAX;
-		vert[texvert_idx + 2].tex_coord[0] = FLT_MAX;
-		vert[texvert_idx + 3].tex_coord[0] = FLT_MAX;
+		vert[0].tex_coord[0] = FLT_MAX;
+		vert[1].tex_coord[0] = FLT_MAX;
+		vert[2].tex_coord[0] = FLT_MAX;
+		vert[3].tex_coord[0] = FLT_MAX;
 	}
-	memcpy(&vert[texvert_idx + 0].color, &color, 4);
-	memcpy(&vert[texvert_idx + 1].color, &color, 4);
-	memcpy(&vert[texvert_idx + 2].color, &color, 4);
-	memcpy(&vert[texvert_idx + 3].color, &color, 4);
-
-	/* update index buffer */
-	index_buf[index_idx + 0] = texvert_idx + 0;
-	index_buf[index_idx + 1] = texvert_idx + 1;
-	index_buf[index_idx + 2] = texvert_idx + 2;
-	index_buf[index_idx + 3] = texvert_idx + 2;
-	index_buf[index_idx + 4] = texvert_idx + 3;
-	index_buf[index_idx + 5] = texvert_idx + 1;
-
+	memcpy(&vert[0].color, &color, 4);
+	memcpy(&vert[1].color, &color, 4);
+	memcpy(&vert[2].color, &color, 4);
+	memcpy(&vert[3].color, &color, 4);
 }
 
 void PresentUI()
 {
+	//a cached ui command buffer is replayed in later frames, it can not carry this frame's query indices.
+	int scope = ui_cache.value ? -1 : profiler::GpuBeginScope("ui");
 	vkCmdBindVertexBuffers(command_buffer, 0, 1, &ui.buffer[0], &ui.buffer_offset[0]);
-	vkCmdBindIndexBuffer(command_buffer, ui.buffer[1], ui.buffer_offset[1], VK_INDEX_TYPE_UINT32);
+	vkCmdBindIndexBuffer(command_buffer, ui.buffer[1], ui.buffer_offset[1], VK_INDEX_TYPE_UINT16);
 	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[1]);
 	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout[0], 2, 1, &tex_descriptor_sets[0], 0, nullptr);
 	vkCmdDrawIndexed(command_buffer, ui.buf_idx * 6, 1, 0, 0, 0);
-	ui.buf_idx = 0;
+	profiler::GpuEndScope(scope);
 }
 
+/*
+UI quads live in their own persistently mapped vertex ring of UI_FRAMES
+regions, so the ring can be reallocated without leaking dynamic buffer space.
+Indices are one static 16-bit pattern shared by every quad.
+*/
 void InitUI()
 {
-	ui.buffer_size += 1000;
-	ui.vertex_data = control::VertexBufferDigress(sizeof(Uivertex) * ui.buffer_size * 4, &ui.buffer[0], &ui.buffer_offset[0]);
-	ui.index_data = (uint32_t*) control::IndexBufferDigress(ui.buffer_size * 6 * sizeof(uint32_t), &ui.buffer[1], &ui.buffer_offset[1]);
+	if(!ui.index_data)
+	{
+		ui.index_data = (uint16_t*) control::IndexBufferDigress(UI_MAX_QUADS * 6 * sizeof(uint16_t), &ui.buffer[1], &ui.buffer_offset[1]);
+		for(uint32_t i = 0; i<UI_MAX_QUADS; i++)
+		{
+			ui.index_data[i*6 + 0] = i*4 + 0;
+			ui.index_data[i*6 + 1] = i*4 + 1;
+			ui.index_data[i*6 + 2] = i*4 + 2;
+			ui.index_data[i*6 + 3] = i*4 + 2;
+			ui.index_data[i*6 + 4] = i*4 + 3;
+			ui.index_data[i*6 + 5] = i*4 + 1;
+		}
+		ui.buffer_size = UI_INITIAL_QUADS;
+	}
+
+	VkBufferCreateInfo buffer_create_info;
+	memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.size = UI_FRAMES * ui.buffer_size * 4 * sizeof(Uivertex);
+	buffer_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	VK_CHECK(vkCreateBuffer(logical_device, &buffer_create_info, nullptr, &ui.buffer[0]));
+
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(logical_device, ui.buffer[0], &memory_requirements);
+
+	VkMemoryAllocateInfo memory_allocate_info;
+	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = memory_requirements.size;
+	memory_allocate_info.memoryTypeIndex = control::MemoryTypeFromProperties(memory_requirements.memoryTypeBits,
+	                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0);
+	VK_CHECK(vkAllocateMemory(logical_device, &memory_allocate_info, nullptr, &ui.memory));
+	VK_CHECK(vkBindBufferMemory(logical_device, ui.buffer[0], ui.memory, 0));
+
+	void* data;
+	VK_CHECK(vkMapMemory(logical_device, ui.memory, 0, VK_WHOLE_SIZE, 0, &data));
+	ui.mapped = (unsigned char*) data;
+	ui.frame = 0;
+	ui.buffer_offset[0] = 0;
+	ui.vertex_data = ui.mapped;
+	ui.buf_idx = 0;
 }
 
-void InitAtlasTexture()
+//Main thread, before the UI thread records. Returns true when the ring was reallocated.
+bool PrepareUI()
 {
-	textures::UploadTexture(atlas_texture, ATLAS_WIDTH, ATLAS_HEIGHT, VK_FORMAT_R8_UNORM);
+	bool grown = false;
+	if(ui.overflow && ui.buffer_size < UI_MAX_QUADS)
+	{
+		//frames in flight may still read the old ring.
+		control::RetireBuffer(ui.buffer[0]);
+		control::RetireMemory(ui.memory);
+		ui.buffer_size = q_min(ui.buffer_size * 2, UI_MAX_QUADS);
+		trace("Growing ui ring to %d quads.", ui.buffer_size);
+		InitUI();
+		grown = true;
+	}
+	ui.overflow = false;
+	return grown;
+}
+
+/*
+UI thread, only when the ui is recorded again. The region of the last recorded
+frame is left untouched, a cached command buffer may still be replayed from it.
+*/
+void BeginUI()
+{
+	ui.frame = (ui.frame + 1) % UI_FRAMES;
+	ui.buffer_offset[0] = ui.frame * ui.buffer_size * 4 * sizeof(Uivertex);
+	ui.vertex_data = ui.mapped + ui.buffer_offset[0];
+	ui.buf_idx = 0;
 }
 
-void Text(const char *text, mu_Vec2 pos, mu_Color color)
+void DestroyUI()
 {
-	mu_Rect dst = { pos.x, pos.y, 0, 0 };
+	vkDestroyBuffer(logical_device, ui.buffer[0], nullptr);
+	vkFreeMemory(logical_device, ui.memory, nullptr);
+}
+
+//Glyph quads cover the distance field padding too, so they start pad pixels early.
+void Text(const char *text, mu_Vec2 pos, mu_Color color, mu_Font font)
+{
+	const font_t* f = font ? (const font_t*) font : font::Default();
+	float pad = FONT_SDF_SPREAD / float(FONT_SDF_SCALE) * f->scale;
+	float x = pos.x;
+	int prev = 0;
 	for (const char *p = text; *p; p++)
 	{
 		if ((*p & 0xc0) == 0x80)
 		{
 			continue;
 		}
-		int chr = mu_min((unsigned char) *p, 127);
-		mu_Rect src = atlas[chr-27];
-		dst.w = src.w;
-		dst.h = src.h;
-		push_quad(dst, src, color, true);
-		dst.x += dst.w;
+		int chr = font::Codepoint(p);
+		x += font::Kerning(f, prev, chr);
+		prev = chr;
+
+		const glyph_t* g = font::Glyph(chr);
+		if(g)
+		{
+			mu_Rect dst;
+			dst.x = int(x - pad + 0.5f);
+			dst.y = int(pos.y - pad + 0.5f);
+			dst.w = int(g->w * f->scale / FONT_SDF_SCALE + 0.5f);
+			dst.h = int(g->h * f->scale / FONT_SDF_SCALE + 0.5f);
+			push_quad(dst, mu_rect(g->x, g->y, g->w, g->h), color, true);
+		}
+		x += f->advance[chr];
 	}
 }
 
 void Rect(mu_Rect rect, mu_Color color)
 {
-	push_quad(rect, atlas[5], color, false);
+	push_quad(rect, mu_rect(0, 0, 0, 0), color, false);
 }
 
 
 void Icon(int id, mu_Rect rect, mu_Color color)
 {
-	mu_Rect src = atlas[id-1];
-	int x = rect.x + (rect.w - src.w) / 2;
-	int y = rect.y + (rect.h - src.h) / 2;
-	push_quad(mu_rect(x, y, src.w, src.h), src, color, true);
+	const glyph_t* g = font::Glyph(id);
+	if(!g)
+	{
+		return;
+	}
+	mu_Rect src = font::Source(id);
+	int pad = FONT_SDF_SPREAD / FONT_SDF_SCALE;
+	int x = rect.x + (rect.w - src.w) / 2 - pad;
+	int y = rect.y + (rect.h - src.h) / 2 - pad;
+	push_quad(mu_rect(x, y, src.w + pad * 2, src.h + pad * 2), mu_rect(g->x, g->y, g->w, g->h), color, true);
 }
 
 void Stats()
 {
+	//sampled with lastfps, so an idle ui does not change every frame.
+	static double shown_fps = -1;
+	static double shown_frametime = 0;
+	if(shown_fps != lastfps)
+	{
+		shown_fps = lastfps;
+		shown_frametime = frametime;
+	}
+
 	char output[75] = "Frametime:            ";
-	snprintf(&output[12], 50, "%f", frametime);
+	snprintf(&output[12], 50, "%f", shown_frametime);
 	Text(output, {0,0}, {255, 0, 0, 255});
 	zone::Q_memcpy(output, "FPS:            ", 16);
 	snprintf(&output[5], 50, "%f", lastfps);
@@ -402,64 +522,51 @@ void Cursor()
 		for(int i = 0; i<2; i++)
 		{
 
-			int texvert_idx = ui.buf_idx * 4;
-			int   index_idx = ui.buf_idx * 6;
-			ui.buf_idx++;
-			if(ui.buf_idx == ui.buffer_size-1)
+			Uivertex* vert = ui_quad();
+			if(!vert)
 			{
-				warn("Possibly out of ui memory!");
-				InitUI();
+				return;
 			}
-			Uivertex* vert = (Uivertex*) ui.vertex_data;
-			uint32_t* index_buf = ui.index_data;
 
-			vert[texvert_idx + 0].pos[0] = xm;
-			vert[texvert_idx + 0].pos[1] = ym;
-			vert[texvert_idx + 1].pos[0] = xm+10;
-			vert[texvert_idx + 1].pos[1] = ym+10;
+			vert[0].pos[0] = xm;
+			vert[0].pos[1] = ym;
+			vert[1].pos[0] = xm+10;
+			vert[1].pos[1] = ym+10;
 			if(!i)
 			{
-				vert[texvert_idx + 2].pos[0] = xm+10;
-				vert[texvert_idx + 2].pos[1] = ym+25;
+				vert[2].pos[0] = xm+10;
+				vert[2].pos[1] = ym+25;
 			}
 			else
 			{
 				//draw the second half of the cursor
-				vert[texvert_idx + 2].pos[0] = xm+25;
-				vert[texvert_idx + 2].pos[1] = ym+10;
+				vert[2].pos[0] = xm+25;
+				vert[2].pos[1] = ym+10;
 			}
 
-			vert[texvert_idx + 3].pos[0] = vert[texvert_idx + 2].pos[0];
-			vert[texvert_idx + 3].pos[1] = vert[texvert_idx + 2].pos[1];
-			vert[texvert_idx + 0].tex_coord[0] = FLT_MAX;
-			vert[texvert_idx + 1].tex_coord[0] = FLT_MAX;
-			vert[texvert_idx + 2].tex_coord[0] = FLT_MAX;
-			vert[texvert_idx + 3].tex_coord[0] = FLT_MAX;
+			vert[3].pos[0] = vert[2].pos[0];
+			vert[3].pos[1] = vert[2].pos[1];
+			vert[0].tex_coord[0] = FLT_MAX;
+			vert[1].tex_coord[0] = FLT_MAX;
+			vert[2].tex_coord[0] = FLT_MAX;
+			vert[3].tex_coord[0] = FLT_MAX;
 
 			mu_Color color;
 			color.r = 255;
 			color.g = 69;
 			color.b = 0;
 			color.a = alpha;
-			memcpy(&vert[texvert_idx + 0].color, &color, 4);
-			memcpy(&vert[texvert_idx + 1].color, &color, 4);
-			memcpy(&vert[texvert_idx + 2].color, &color, 4);
-			memcpy(&vert[texvert_idx + 3].color, &color, 4);
-
-			/* update index buffer */
-			index_buf[index_idx + 0] = texvert_idx + 0;
-			index_buf[index_idx + 1] = texvert_idx + 1;
-			index_buf[index_idx + 2] = texvert_idx + 2;
-			index_buf[index_idx + 3] = texvert_idx + 2;
-			index_buf[index_idx + 4] = texvert_idx + 3;
-			index_buf[index_idx + 5] = texvert_idx + 1;
-
+			memcpy(&vert[0].color, &color, 4);
+			memcpy(&vert[1].color, &color, 4);
+			memcpy(&vert[2].color, &color, 4);
+			memcpy(&vert[3].color, &color, 4);
 		}
 	}
 }
 
 void InitSkydome()
 {
+	CPU_SCOPE("InitSkydome");
 	// Generate sphere
 	float radius = 10.0f;
 	unsigned int slices = 25;
@@ -539,6 +646,7 @@ void InitSkydome()
 
 void SkyDome()
 {
+	GPU_SCOPE("sky");
 	sky.sky_uniform->SkyColor[0] = 0.33f;
 	sky.sky_uniform->SkyColor[1] = 0.66f;
 	sky.sky_uniform->SkyColor[2] = 0.99f;
@@ -4,6 +4,10 @@
 #include "microui.h"
 #include "entity.h"
 
+#define UI_FRAMES 2 //vertex ring regions, one per frame in flight.
+#define UI_INITIAL_QUADS 1024
+#define UI_MAX_QUADS 16384 //4 vertices per quad must fit 16-bit indices.
+
 namespace draw
 {
 
@@ -11,7 +15,7 @@ extern int buf_idx;
 
 void Quad(size_t size, Uivertex* vertices, size_t index_count, uint16_t* index_array);
 void Triangle(size_t size, float4_t* vertices);
-void Meshes();
+bool Meshes();
 void CameraVectors();
 void Line(vec3_t from, vec3_t to, vec3_t color, basic_ent_t& ent);
 void PresentUI();
@@ -19,9 +23,11 @@ int r_get_text_width(const char *text, int len);
 int text_width(mu_Font font, const char *text, int len);
 int text_height(mu_Font font);
 void InitUI();
-void InitAtlasTexture();
+bool PrepareUI();
+void BeginUI();
+void DestroyUI();
 void Rect(mu_Rect rect, mu_Color color);
-void Text(const char *text, mu_Vec2 pos, mu_Color color);
+void Text(const char *text, mu_Vec2 pos, mu_Color color, mu_Font font = nullptr);
 void Icon(int id, mu_Rect rect, mu_Color color);
 void Stats();
 void Cursor();
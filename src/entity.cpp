@@ -3,16 +3,30 @@
 #include "zone.h"
 #include "control.h"
 #include "flog.h"
+#include "profiler.h"
+#include "cvar.h"
+#include "jobs.h"
+#include "BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h"
+#include "LinearMath/btConvexHullComputer.h"
+#include "BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h"
+#include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h"
 #include <vector>
+#include <mutex>
 
 cam_ent_t cam;
-mesh_ent_t* meshes;
+mesh_t meshes[MAX_MESHES];
+uint32_t mesh_count = 0;
+ent_store_t ents;
+instance_buffer_t instances;
 btDiscreteDynamicsWorld* dynamicsWorld;
 
 static btBroadphaseInterface* broadphase;
+static int broadphase_type = BROADPHASE_DBVT;
+static const char* broadphase_names[] = {"dbvt", "axis sweep", "32 bit axis sweep"};
 static btDefaultCollisionConfiguration* collisionConfiguration;
 static btCollisionDispatcher* dispatcher;
 static btSequentialImpulseConstraintSolver* solver;
+static btConstraintSolverPoolMt* solver_pool; //only for the multithreaded world.
 static btTypedConstraint* m_pickedConstraint;
 static int m_savedState;
 static btRigidBody* m_pickedBody;
@@ -20,12 +34,122 @@ static btVector3 m_oldPickingPos;
 static btVector3 m_hitPos;
 static btScalar m_oldPickingDist;
 
-static char* smeshes[][1] =
+static uint16_t ent_generation[MAX_ENTITIES];
+static uint16_t ent_slot[MAX_ENTITIES]; //index -> dense slot in ents.
+static uint16_t ent_free[MAX_ENTITIES];
+static uint32_t ent_free_count = 0;
+static uint32_t ent_index_count = 0; //indices handed out at least once.
+static uint16_t mesh_index[MESH_HASH_SIZE]; //mesh number + 1, 0 is an empty bucket.
+static uint16_t ent_visible[MAX_ENTITIES]; //slots that passed CullEntities.
+static btDbvt scene_tree;
+static std::mutex scene_mutex;
+static btRigidBody* body_pool; //MAX_ENTITIES, indexed like ent_generation.
+static uint16_t ent_moved[MAX_ENTITIES]; //indices whose body moved since the last SyncTransforms.
+static uint32_t ent_moved_count = 0;
+static bool ent_moved_flag[MAX_ENTITIES];
+static bool ent_frozen[MAX_ENTITIES]; //put to sleep by the physics LOD while it was moving.
+static btVector3 frozen_velocity[MAX_ENTITIES][2]; //linear and angular, sleeping bodies are zeroed by Bullet.
+static uint32_t lod_cursor = 0; //next slot of the LOD sweep.
+static uint32_t lod_frame = 0;
+static uint32_t lod_seen[MAX_ENTITIES]; //slot -> last lod_frame the frustum query found it in.
+
+//Bullet only calls setWorldTransform for bodies that are awake, a sleeping body is never queued.
+ATTRIBUTE_ALIGNED16(class) EntMotionState : public btMotionState
 {
-	{"./res/kitty.obj"},
-	{"./res/doch.obj"},
-	{"./res/plane.obj"},
-	{"./res/cube.obj"},
+public:
+	BT_DECLARE_ALIGNED_ALLOCATOR();
+	btTransform transform;
+	uint32_t index; //entity index, the dense slot can change before SyncTransforms.
+
+	EntMotionState(const btTransform& start, uint32_t index) : transform(start), index(index)
+	{
+		setWorldTransform(start);
+	}
+	virtual void getWorldTransform(btTransform& worldTrans) const
+	{
+		worldTrans = transform;
+	}
+	virtual void setWorldTransform(const btTransform& worldTrans)
+	{
+		transform = worldTrans;
+		if(!ent_moved_flag[index])
+		{
+			ent_moved_flag[index] = true;
+			ent_moved[ent_moved_count++] = index;
+		}
+	}
+};
+static EntMotionState* motion_pool;
+
+//Replay log, see FIXED STEP AND REPLAY.
+#define REPLAY_MAGIC 0x50455256 //"VREP"
+#define REPLAY_VERSION 1
+
+enum
+{
+	INPUT_LAUNCH, //a = position, b = velocity.
+	INPUT_PICK, //a = ray from, b = ray to.
+	INPUT_DRAG,
+	INPUT_RELEASE
+};
+
+typedef struct
+{
+	uint32_t tick;
+	uint16_t type;
+	uint16_t mesh;
+	float a[3];
+	float b[3];
+} input_event_t;
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	float hz;
+	uint32_t ticks;
+	uint32_t bodies; //body_snapshot_t entries after the header.
+	uint32_t events; //input_event_t entries after the bodies.
+	uint64_t hash; //world state after the last tick.
+} replay_header_t;
+
+static double physics_accum = 0.0;
+static uint32_t physics_tick = 0; //ticks since the recording began.
+static bool recording = false;
+static std::vector<input_event_t> input_log;
+
+static void RecordInput(uint16_t type, uint16_t mesh, const float a[3], const float b[3])
+{
+	if(!recording)
+	{
+		return;
+	}
+	input_event_t e;
+	zone::Q_memset(&e, 0, sizeof(e));
+	e.tick = physics_tick;
+	e.type = type;
+	e.mesh = mesh;
+	if(a)
+	{
+		VectorCopy(a, e.a);
+	}
+	if(b)
+	{
+		VectorCopy(b, e.b);
+	}
+	input_log.push_back(e);
+}
+
+static const struct
+{
+	char* path;
+	collision_t collision;
+} smeshes[] =
+{
+	{"./res/kitty.obj", COLLISION_HULL},
+	{"./res/doch.obj", COLLISION_HULL},
+	{"./res/plane.obj", COLLISION_MESH},
+	{"./res/cube.obj", COLLISION_HULL},
 };
 
 namespace entity
@@ -122,79 +246,306 @@ size_t TriangulateObj(fastObjMesh* obj, std::vector<Vertex_>& vertices)
 	return vertex_offset;
 }
 
-void MeshCollisionModel(mesh_ent_t* mesh)
+//Bodies and motion states live in the pools at their entity index, spawning never reaches the zone.
+static btRigidBody* CreateBody(uint32_t index, const mesh_t* mesh, const btTransform& transform, int user)
+{
+	EntMotionState* motionState = new(&motion_pool[index]) EntMotionState(transform, index);
+	btRigidBody::btRigidBodyConstructionInfo rigidBodyCI(mesh->mass, motionState, mesh->colShape, mesh->inertia);
+	btRigidBody* body = new(&body_pool[index]) btRigidBody(rigidBodyCI);
+	body->setUserIndex(user);
+	body->setFriction(1.0f);
+	dynamicsWorld->addRigidBody(body);
+	return body;
+}
+
+static void DestroyBody(btRigidBody* body)
 {
-	btVector3 inertia = btVector3(0.0f, 0.0f, 0.0f);
-	mesh->collisionMesh = new btTriangleMesh();
-	mesh->collisionMesh->m_indexedMeshes[0].m_numTriangles = mesh->index_count / 3;
-	mesh->collisionMesh->m_indexedMeshes[0].m_numVertices = mesh->vertex_count;
-	Vertex_* ptr = (Vertex_*)mesh->vertex_data;
-	for(uint32_t i = 0; i<mesh->vertex_count; i++)
+	if(body->isInWorld())
 	{
-		mesh->collisionMesh->m_3componentVertices.push_back(ptr->pos[0]);
-		mesh->collisionMesh->m_3componentVertices.push_back(ptr->pos[1]);
-		mesh->collisionMesh->m_3componentVertices.push_back(ptr->pos[2]);
-		ptr++;
+		dynamicsWorld->removeRigidBody(body); //the physics LOD may have parked it.
 	}
+	btMotionState* motionState = body->getMotionState();
+	body->~btRigidBody();
+	motionState->~btMotionState();
+}
 
-	for(uint32_t i = 0; i<mesh->index_count; i++)
+//Hull of the points a simplified copy of the mesh still uses, meshopt keeps the silhouette.
+static btCollisionShape* CookHull(mesh_t* mesh)
+{
+	const Vertex_* vertices = (const Vertex_*) mesh->vertex_data;
+	std::vector<uint32_t> indices(mesh->index_count);
+	size_t target = q_min(mesh->index_count, (uint32_t) COLLISION_HULL_INDICES);
+	size_t count = meshopt_simplify(indices.data(), mesh->index_data, mesh->index_count, vertices[0].pos,
+	                                mesh->vertex_count, sizeof(Vertex_), target, COLLISION_HULL_ERROR);
+
+	std::vector<bool> used(mesh->vertex_count, false);
+	std::vector<float> points;
+	points.reserve(count * 3);
+	for(size_t i = 0; i<count; i++)
 	{
-		mesh->collisionMesh->m_32bitIndices.push_back(mesh->index_data[i]);
+		uint32_t v = indices[i];
+		if(!used[v])
+		{
+			used[v] = true;
+			points.insert(points.end(), vertices[v].pos, vertices[v].pos + 3);
+		}
 	}
-	mesh->collisionMesh->m_indexedMeshes[0].m_triangleIndexBase = (unsigned char*)&mesh->collisionMesh->m_32bitIndices[0];
-	mesh->collisionMesh->m_indexedMeshes[0].m_vertexBase = (unsigned char*)&mesh->collisionMesh->m_3componentVertices[0];
 
-	mesh->collisionShape = new btGImpactMeshShape(mesh->collisionMesh);
-	mesh->collisionShape->setLocalScaling(btVector3(1, 1, 1));
-	mesh->collisionShape->setMargin(0.0f);
-	mesh->collisionShape->updateBound();
+	btConvexHullComputer hull;
+	if(points.size() < 12 || hull.compute(points.data(), 3 * sizeof(float), points.size() / 3, 0.0f, 0.0f) < 0.0f || !hull.vertices.size())
+	{
+		warn("No convex hull for %s, it collides as a sphere.", mesh->name);
+		return new btSphereShape(mesh->radius);
+	}
+	btConvexHullShape* shape = new btConvexHullShape(&hull.vertices[0].getX(), hull.vertices.size(), sizeof(btVector3));
+	trace("%s hull: %u triangles -> %d points.", mesh->name, mesh->index_count / 3, hull.vertices.size());
+	return shape;
+}
 
-	btTransform transform;
-	transform.setIdentity();
-	btDefaultMotionState* motionState = new btDefaultMotionState(transform);
-	btRigidBody::btRigidBodyConstructionInfo rigidBodyCI(0.f, motionState, mesh->collisionShape, inertia);
-	mesh->rigidBody = new btRigidBody(rigidBodyCI);
-	dynamicsWorld->addRigidBody(mesh->rigidBody);
-	mesh->rigidBody->setFriction(1.0f);
+/*
+==============================================================================
+
+					COLLISION CACHE
+
+A cooked shape is written next to its asset as <path>.col and read back on the
+next launch instead of being cooked again. A hull is stored as its points. A
+triangle mesh is stored as its bvh in Bullet's in-place format, which is used
+straight from the loaded buffer. A hash of the vertex and index data and of
+the cook parameters tells a stale cache apart.
+==============================================================================
+*/
+
+#define COOK_MAGIC 0x4c4f4356 //"VCOL"
+#define COOK_VERSION 2
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t collision;
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t size; //payload bytes after the header.
+	uint32_t hash; //CookHash of the source mesh.
+	uint32_t pad; //the payload starts 16 byte aligned.
+} cook_header_t;
+
+//Anything that changes the cooked shape, an edited asset with the same topology included.
+static uint32_t CookHash(const mesh_t* mesh)
+{
+	const uint32_t params[] = {uint32_t(mesh->collision), COLLISION_HULL_INDICES};
+	const float error = COLLISION_HULL_ERROR;
+	uint32_t hash = zone::Q_hash(mesh->vertex_data, mesh->vertex_count * sizeof(Vertex_));
+	hash = zone::Q_hash(mesh->index_data, mesh->index_count * sizeof(uint32_t), hash);
+	hash = zone::Q_hash(params, sizeof(params), hash);
+	return zone::Q_hash(&error, sizeof(error), hash);
+}
+
+//keep puts the payload in hunk memory for good, otherwise it only lives until the next temp alloc.
+static void* LoadCooked(const mesh_t* mesh, uint32_t* size, bool keep)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s.col", mesh->name);
+	FILE* file = fopen(path, "rb");
+	if(!file)
+	{
+		return nullptr;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	cook_header_t header;
+	void* data = nullptr;
+	if(fread(&header, sizeof(header), 1, file) == 1 && header.magic == COOK_MAGIC && header.version == COOK_VERSION &&
+	   header.collision == uint32_t(mesh->collision) && header.vertex_count == mesh->vertex_count &&
+	   header.index_count == mesh->index_count && header.hash == CookHash(mesh) && header.size &&
+	   length == long(sizeof(header) + header.size))
+	{
+		data = keep ? zone::Hunk_AllocName(header.size, "cooked") : zone::Hunk_TempAlloc(header.size);
+		size_t rc = fread(data, 1, header.size, file);
+		ASSERT(rc == header.size, "Failed to read");
+		*size = header.size;
+	}
+	else
+	{
+		warn("%s is stale, the shape is cooked again.", path);
+	}
+	fclose(file);
+	return data;
+}
+
+static void SaveCooked(const mesh_t* mesh, const void* data, uint32_t size)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s.col", mesh->name);
+	FILE* file = fopen(path, "wb");
+	if(!file)
+	{
+		warn("Could not write %s.", path);
+		return;
+	}
+	cook_header_t header = {COOK_MAGIC, COOK_VERSION, uint32_t(mesh->collision), mesh->vertex_count, mesh->index_count, size,
+	                        CookHash(mesh), 0};
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(data, 1, size, file);
+	fclose(file);
+}
+
+static btCollisionShape* LoadHull(mesh_t* mesh)
+{
+	uint32_t size;
+	float* points = (float*) LoadCooked(mesh, &size, false);
+	if(points)
+	{
+		return new btConvexHullShape(points, size / (3 * sizeof(float)), 3 * sizeof(float));
+	}
+
+	btCollisionShape* shape = CookHull(mesh);
+	if(shape->getShapeType() == CONVEX_HULL_SHAPE_PROXYTYPE)
+	{
+		btConvexHullShape* hull = (btConvexHullShape*) shape;
+		std::vector<float> cooked;
+		cooked.reserve(hull->getNumPoints() * 3);
+		for(int i = 0; i<hull->getNumPoints(); i++)
+		{
+			const btVector3& v = hull->getUnscaledPoints()[i];
+			cooked.insert(cooked.end(), {float(v.getX()), float(v.getY()), float(v.getZ())});
+		}
+		SaveCooked(mesh, cooked.data(), cooked.size() * sizeof(float));
+	}
+	return shape;
+}
+
+//The bvh is built over the mapped vertex and index buffers, nothing is copied.
+static btCollisionShape* LoadTriangleMesh(mesh_t* mesh)
+{
+	btIndexedMesh part;
+	part.m_numTriangles = mesh->index_count / 3;
+	part.m_triangleIndexBase = (const unsigned char*) mesh->index_data;
+	part.m_triangleIndexStride = 3 * sizeof(uint32_t);
+	part.m_numVertices = mesh->vertex_count;
+	part.m_vertexBase = mesh->vertex_data;
+	part.m_vertexStride = sizeof(Vertex_);
+	part.m_indexType = PHY_INTEGER;
+	part.m_vertexType = PHY_FLOAT;
+	btTriangleIndexVertexArray* array = new btTriangleIndexVertexArray();
+	array->addIndexedMesh(part, PHY_INTEGER);
+	mesh->collisionMesh = array;
+
+	uint32_t size;
+	void* data = LoadCooked(mesh, &size, true);
+	if(data)
+	{
+		btBvhTriangleMeshShape* shape = new btBvhTriangleMeshShape(array, true, false);
+		shape->setOptimizedBvh(btOptimizedBvh::deSerializeInPlace(data, size, false));
+		return shape;
+	}
+
+	btBvhTriangleMeshShape* shape = new btBvhTriangleMeshShape(array, true);
+	btOptimizedBvh* bvh = shape->getOptimizedBvh();
+	size = bvh->calculateSerializeBufferSize();
+	void* buffer = btAlignedAlloc(size, 16);
+	if(bvh->serializeInPlace(buffer, size, false))
+	{
+		SaveCooked(mesh, buffer, size);
+	}
+	btAlignedFree(buffer);
+	return shape;
 }
 
+//Builds the one shape every entity of the mesh shares, or loads it from the cache.
+static void CookCollision(mesh_t* mesh, collision_t collision)
+{
+	CPU_SCOPE("CookCollision");
+	mesh->collision = collision;
+	mesh->collisionMesh = nullptr;
+	mesh->mass = ENT_MASS;
+	switch(collision)
+	{
+		case COLLISION_HULL:
+			mesh->colShape = LoadHull(mesh);
+			break;
+		case COLLISION_MESH:
+			mesh->colShape = LoadTriangleMesh(mesh);
+			mesh->mass = 0.0f;
+			break;
+		default:
+			mesh->colShape = new btSphereShape(mesh->radius);
+			break;
+	}
+	mesh->inertia = btVector3(0.0f, 0.0f, 0.0f);
+	if(mesh->mass > 0.0f)
+	{
+		mesh->colShape->calculateLocalInertia(mesh->mass, mesh->inertia);
+	}
+}
 
 void SetupWorldPlane(float size)
 {
-	mesh_ent_t* mesh = GetMesh("./res/plane.obj", nullptr);
-	btVector3 inertia = btVector3(0.0f, 0.0f, 0.0f);
-	dynamicsWorld->removeRigidBody(mesh->rigidBody);
+	mesh_t* mesh = GetMesh("./res/plane.obj");
+	int slot = Slot(mesh->root);
+	DestroyBody(ents.body[slot]);
 	delete mesh->colShape;
-	delete mesh->rigidBody;
+	delete mesh->collisionMesh;
+	mesh->collisionMesh = nullptr;
+	mesh->collision = COLLISION_SPHERE;
+	mesh->mass = 0.0f;
+	mesh->inertia = btVector3(0.0f, 0.0f, 0.0f);
 	mesh->colShape = new btBoxShape(btVector3(btScalar(size), btScalar(size), btScalar(size)));
 	btTransform transform;
 	transform.setIdentity();
 	transform.setOrigin(btVector3(0, size, 0));
-	btDefaultMotionState* motionState = new btDefaultMotionState(transform);
-	btRigidBody::btRigidBodyConstructionInfo rigidBodyCI(0.f, motionState, mesh->colShape, inertia);
-	mesh->rigidBody = new btRigidBody(rigidBodyCI);
-	dynamicsWorld->addRigidBody(mesh->rigidBody);
-	mesh->rigidBody->setFriction(1.0f);
+	ents.body[slot] = CreateBody(mesh->root & ENT_INDEX_MASK, mesh, transform, int(mesh->root));
 	TranslationMatrix(mesh->mat->view, 0, -size, 0);
 	ScaleMatrix(mesh->mat->view, size, size, size);
+	//the culling bounds follow the model space transform.
+	vec3_t offset = {0, -size, 0};
+	for(int k = 0; k<3; k++)
+	{
+		mesh->mins[k] = mesh->mins[k] * size + offset[k];
+		mesh->maxs[k] = mesh->maxs[k] * size + offset[k];
+		mesh->center[k] = mesh->center[k] * size + offset[k];
+	}
+	mesh->radius *= size;
+	ents.sphere[3][slot] = mesh->radius;
+}
+
+//The bucket stores the mesh number, the name string itself is compared only on a hash match.
+static void IndexMesh(mesh_t* mesh)
+{
+	mesh->name_hash = zone::Q_hash(mesh->name, zone::Q_strlen(mesh->name));
+	uint32_t i = mesh->name_hash;
+	while(mesh_index[i & (MESH_HASH_SIZE - 1)])
+	{
+		i++;
+	}
+	mesh_index[i & (MESH_HASH_SIZE - 1)] = uint16_t(mesh - meshes) + 1;
 }
 
 void InitMeshes()
 {
-	meshes = (mesh_ent_t*) zone::Z_Malloc(sizeof(mesh_ent_t));
-	mesh_ent_t* head = meshes;
+	CPU_SCOPE("InitMeshes");
+	instances.model = (Matrix*) control::VertexBufferDigress((MAX_ENTITIES + 1) * sizeof(Matrix), &instances.buffer, &instances.offset);
+	for(uint32_t i = 0; i<=MAX_ENTITIES; i++)
+	{
+		IdentityMatrix(instances.model[i].mat);
+	}
+
 	for(uint8_t i = 0; i<ARRAYSIZE(smeshes); i++)
 	{
-		head->name = smeshes[i][0];
-		head->obj = fast_obj_read(smeshes[i][0]);
+		mesh_t* mesh = &meshes[mesh_count++];
+		mesh->name = smeshes[i].path;
+		IndexMesh(mesh);
+		fastObjMesh* obj = fast_obj_read(smeshes[i].path);
 		size_t index_count = 0;
-		for (unsigned int i = 0; i < head->obj->face_count; ++i)
+		for (unsigned int i = 0; i < obj->face_count; ++i)
 		{
-			index_count += 3 * (head->obj->face_vertices[i] - 2);
+			index_count += 3 * (obj->face_vertices[i] - 2);
 		}
 
 		std::vector<Vertex_> triangle_vertices(index_count);
-		size_t offs = TriangulateObj(head->obj, triangle_vertices);
+		size_t offs = TriangulateObj(obj, triangle_vertices);
 		ASSERT(offs == index_count, "");
 
 		std::vector<uint32_t> remap(index_count);
@@ -209,117 +560,237 @@ void InitMeshes()
 		meshopt_optimizeVertexCache(indices.data(), indices.data(), index_count, vertex_count);
 		meshopt_optimizeVertexFetch(vertices.data(), indices.data(), index_count, vertices.data(), vertex_count, sizeof(Vertex_));
 
-		head->mat = (UniformMatrix*) control::UniformBufferDigress(sizeof(UniformMatrix), &head->buffer[3], &head->uniform_offset[0], &head->dset[0], 0);
-		head->vertex_data = control::VertexBufferDigress(vertices.size()*sizeof(Vertex_), &head->buffer[0], &head->buffer_offset[0]);
-		head->index_data = (uint32_t*) control::IndexBufferDigress(indices.size()*sizeof(uint32_t), &head->buffer[1], &head->buffer_offset[1]);
+		mesh->vertex_data = control::VertexBufferDigress(vertices.size()*sizeof(Vertex_), &mesh->buffer[0], &mesh->buffer_offset[0]);
+		mesh->index_data = (uint32_t*) control::IndexBufferDigress(indices.size()*sizeof(uint32_t), &mesh->buffer[1], &mesh->buffer_offset[1]);
 
-		head->vertex_count = vertices.size();
-		head->index_count = indices.size();
-		zone::Q_memcpy(head->vertex_data, vertices.data(), head->vertex_count*sizeof(Vertex_));
-		zone::Q_memcpy(head->index_data, indices.data(), head->index_count*sizeof(uint32_t));
+		mesh->vertex_count = vertices.size();
+		mesh->index_count = indices.size();
+		zone::Q_memcpy(mesh->vertex_data, vertices.data(), mesh->vertex_count*sizeof(Vertex_));
+		zone::Q_memcpy(mesh->index_data, indices.data(), mesh->index_count*sizeof(uint32_t));
 
-		IdentityMatrix(head->mat->proj);
-		IdentityMatrix(head->mat->model);
-		IdentityMatrix(head->mat->view);
-		float approx_bound = (head->obj->maxvert[0] + head->obj->maxvert[1] + head->obj->maxvert[2])/3;
-		head->colShape = new btSphereShape(approx_bound);
-		btTransform transform;
-		transform.setIdentity();
-		btVector3 inertia = btVector3(0.0f, 0.0f, 0.0f);
-		head->colShape->calculateLocalInertia(100.f, inertia);
-		btDefaultMotionState* motionState = new btDefaultMotionState(transform);
-		btRigidBody::btRigidBodyConstructionInfo rigidBodyCI(100.f, motionState, head->colShape, inertia);
-		head->rigidBody = new btRigidBody(rigidBodyCI);
-		dynamicsWorld->addRigidBody(head->rigidBody);
-		head->rigidBody->setFriction(1.0f);
+		mesh->mat = (UniformMatrix*) control::UniformBufferDigress(sizeof(UniformMatrix), &mesh->uniform_buffer, &mesh->uniform_offset, &mesh->dset, 0);
+		IdentityMatrix(mesh->mat->proj);
+		IdentityMatrix(mesh->mat->model);
+		IdentityMatrix(mesh->mat->view);
+
+		VectorCopy(vertices[0].pos, mesh->mins);
+		VectorCopy(vertices[0].pos, mesh->maxs);
+		for(size_t v = 1; v<vertices.size(); v++)
+		{
+			for(int k = 0; k<3; k++)
+			{
+				mesh->mins[k] = q_min(mesh->mins[k], vertices[v].pos[k]);
+				mesh->maxs[k] = q_max(mesh->maxs[k], vertices[v].pos[k]);
+			}
+		}
+		//centered on the box, the radius reaches the furthest vertex.
+		VectorAdd(mesh->mins, mesh->maxs, mesh->center);
+		VectorScale(mesh->center, 0.5f, mesh->center);
+		float radius2 = 0.0f;
+		for(size_t v = 0; v<vertices.size(); v++)
+		{
+			vec3_t d;
+			VectorSubtract(vertices[v].pos, mesh->center, d);
+			radius2 = q_max(radius2, DotProduct(d, d));
+		}
+		mesh->radius = sqrtf(radius2);
 
-		head->next = (mesh_ent_t*) zone::Z_Malloc(sizeof(mesh_ent_t));
-		head->next->prev = head;
-		head = head->next;
+		CookCollision(mesh, smeshes[i].collision);
+		mesh->root = Spawn(mesh);
 	}
 }
 
-mesh_ent_t* GetMesh(char* name, mesh_ent_t** last)
+//Returns the mesh loaded from the asset path name, null when it is not loaded.
+mesh_t* GetMesh(const char* name)
 {
-	mesh_ent_t* head = meshes;
-	mesh_ent_t* copy = nullptr;
-	while(head->vertex_data)
+	uint32_t hash = zone::Q_hash(name, zone::Q_strlen(name));
+	for(uint32_t i = hash; ; i++)
 	{
-		if(head->name)
+		uint16_t m = mesh_index[i & (MESH_HASH_SIZE - 1)];
+		if(m == 0)
 		{
-			if(zone::Q_strcmp(head->name, name) == 0)
-			{
-				copy = head;
-			}
+			return nullptr;
+		}
+		mesh_t* mesh = &meshes[m - 1];
+		if(mesh->name_hash == hash && zone::Q_strcmp(mesh->name, name) == 0)
+		{
+			return mesh;
 		}
-		head = head->next;
 	}
-	if(last)
+}
+
+/*
+==============================================================================
+
+					ENTITY STORE
+
+Entities are packed at the front of the ents arrays, so per-frame work is a
+linear sweep. Handles are an index plus a generation. Despawn moves the last
+entity into the freed slot and bumps the generation, so old handles fail
+Slot() instead of aliasing the next entity.
+==============================================================================
+*/
+
+//world bounds of a dense slot as a scene tree volume.
+static btDbvtVolume EntityVolume(uint32_t slot)
+{
+	return btDbvtVolume::FromMM(btVector3(ents.mins[slot][0], ents.mins[slot][1], ents.mins[slot][2]),
+	                            btVector3(ents.maxs[slot][0], ents.maxs[slot][1], ents.maxs[slot][2]));
+}
+
+int Slot(ent_t ent)
+{
+	uint32_t index = ent & ENT_INDEX_MASK;
+	if(index >= ent_index_count || ent_generation[index] != (ent >> ENT_INDEX_BITS))
 	{
-		*last = head;
+		return -1;
 	}
-	return copy;
+	return ent_slot[index];
+}
+
+btRigidBody* Body(ent_t ent)
+{
+	int slot = Slot(ent);
+	return (slot < 0) ? nullptr : ents.body[slot];
 }
 
-//make a soft dublicate of the entity
-mesh_ent_t* InstanceMesh(char* name)
+ent_t Spawn(mesh_t* mesh)
 {
-	mesh_ent_t* head = nullptr;
-	mesh_ent_t* copy = GetMesh(name, &head);
-	if(copy)
+	uint32_t index;
+	if(ent_free_count)
 	{
-		// always have an empty node allocated at the back.
-		head->parent = copy;
-		head->obj = copy->obj;
-		head->vertex_data = copy->vertex_data;
-		head->index_data = copy->index_data;
-		head->vertex_count = copy->vertex_count;
-		head->index_count = copy->index_count;
-		zone::Q_memcpy(&head->buffer[0], &copy->buffer[0], sizeof(head->buffer));
-		zone::Q_memcpy(&head->dset[0], &copy->dset[0], sizeof(head->dset));
-		zone::Q_memcpy(&head->buffer_offset[0], &copy->buffer_offset[0], sizeof(head->buffer_offset));
-		head->mat = (UniformMatrix*) control::UniformBufferDigress(sizeof(UniformMatrix), &head->buffer[3], &head->uniform_offset[0], &head->dset[0], 0);
-		IdentityMatrix(head->mat->proj);
-		IdentityMatrix(head->mat->model);
-		IdentityMatrix(head->mat->view);
-		head->collisionMesh = copy->collisionMesh;
-		head->collisionShape = copy->collisionShape;
-		head->colShape = copy->colShape;
-		btTransform transform;
-		transform.setIdentity();
-		btVector3 inertia = btVector3(0.0f, 0.0f, 0.0f);
-		head->colShape->calculateLocalInertia(100.f, inertia);
-		btDefaultMotionState* motionState = new btDefaultMotionState(transform);
-		btRigidBody::btRigidBodyConstructionInfo rigidBodyCI(100.f, motionState, head->colShape, inertia);
-		head->rigidBody = new btRigidBody(rigidBodyCI);
-		dynamicsWorld->addRigidBody(head->rigidBody);
-		head->rigidBody->setFriction(1.0f);
-
-		head->next = (mesh_ent_t*) zone::Z_Malloc(sizeof(mesh_ent_t));
-		head->next->prev = head;
+		index = ent_free[--ent_free_count];
+	}
+	else if(ent_index_count < MAX_ENTITIES)
+	{
+		index = ent_index_count++;
+		ent_generation[index] = 1;
 	}
 	else
+	{
+		error("MAX_ENTITIES reached, %s is not spawned.", mesh->name);
+		return ENT_NONE;
+	}
+
+	ent_t ent = (ent_t(ent_generation[index]) << ENT_INDEX_BITS) | index;
+	std::unique_lock<std::mutex> lock(scene_mutex); //CullEntities reads the slots.
+	uint32_t slot = ents.count++;
+	ent_slot[index] = slot;
+	ents.handle[slot] = ent;
+	ents.mesh[slot] = mesh - meshes;
+	ents.origin[slot][0] = ents.origin[slot][1] = ents.origin[slot][2] = 0.0f;
+	IdentityMatrix(ents.transform[slot].mat);
+	VectorCopy(mesh->mins, ents.mins[slot]);
+	VectorCopy(mesh->maxs, ents.maxs[slot]);
+	for(int k = 0; k<3; k++)
+	{
+		ents.sphere[k][slot] = mesh->center[k];
+	}
+	ents.sphere[3][slot] = mesh->radius;
+	ents.leaf[slot] = scene_tree.insert(EntityVolume(slot), (void*)(intptr_t) index);
+	lock.unlock();
+
+	btTransform transform;
+	transform.setIdentity();
+	ent_frozen[index] = false;
+	ents.body[slot] = CreateBody(index, mesh, transform, int(ent));
+	return ent;
+}
+
+void Despawn(ent_t ent)
+{
+	int slot = Slot(ent);
+	if(slot < 0)
+	{
+		warn("Despawn of a stale entity handle %u.", ent);
+		return;
+	}
+
+	btRigidBody* body = ents.body[slot];
+	if(body == m_pickedBody)
+	{
+		RemovePickingConstraint();
+	}
+	DestroyBody(body);
+
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	scene_tree.remove(ents.leaf[slot]);
+	uint32_t last = --ents.count;
+	if(uint32_t(slot) != last)
+	{
+		ents.handle[slot] = ents.handle[last];
+		ents.mesh[slot] = ents.mesh[last];
+		VectorCopy(ents.origin[last], ents.origin[slot]);
+		ents.transform[slot] = ents.transform[last];
+		VectorCopy(ents.mins[last], ents.mins[slot]);
+		VectorCopy(ents.maxs[last], ents.maxs[slot]);
+		for(int k = 0; k<4; k++)
+		{
+			ents.sphere[k][slot] = ents.sphere[k][last];
+		}
+		ents.body[slot] = ents.body[last];
+		ents.leaf[slot] = ents.leaf[last];
+		ent_slot[ents.handle[slot] & ENT_INDEX_MASK] = slot;
+	}
+
+	uint32_t index = ent & ENT_INDEX_MASK;
+	if(++ent_generation[index] == 0)
+	{
+		ent_generation[index] = 1;
+	}
+	ent_free[ent_free_count++] = index;
+}
+
+//spawn one more entity of an already loaded mesh.
+ent_t InstanceMesh(char* name)
+{
+	mesh_t* mesh = GetMesh(name);
+	if(!mesh)
 	{
 		error("mesh ent %s not found!", name);
+		return ENT_NONE;
 	}
-	return head;
+	return Spawn(mesh);
 }
 
-void SetPosition(mesh_ent_t* copy, vec3_t pos)
+//Spawns an entity of mesh at pos moving with velocity, an input the replay log keeps.
+ent_t Launch(mesh_t* mesh, const vec3_t pos, const vec3_t velocity)
 {
-	btTransform transform;
-	copy->rigidBody->getMotionState()->getWorldTransform(transform);
+	if(!mesh)
+	{
+		error("Launch of a mesh that is not loaded.");
+		return ENT_NONE;
+	}
+	RecordInput(INPUT_LAUNCH, uint16_t(mesh - meshes), pos, velocity);
+	ent_t ent = Spawn(mesh);
+	SetPosition(ent, (float*) pos);
+	btRigidBody* body = Body(ent);
+	if(body)
+	{
+		body->setLinearVelocity(btVector3(velocity[0], velocity[1], velocity[2]));
+	}
+	return ent;
+}
+
+void SetPosition(ent_t ent, vec3_t pos)
+{
+	btRigidBody* body = Body(ent);
+	if(!body)
+	{
+		return;
+	}
+	btTransform transform = body->getWorldTransform();
 	transform.setOrigin(btVector3(pos[0], pos[1], pos[2]));
-	copy->rigidBody->getMotionState()->setWorldTransform(transform);
-	copy->rigidBody->setCenterOfMassTransform(transform);
+	body->getMotionState()->setWorldTransform(transform);
+	body->setCenterOfMassTransform(transform);
 }
 
 void MoveTo(char* name, vec3_t pos)
 {
-	mesh_ent_t* copy = GetMesh(name, nullptr);
-	if(copy)
+	mesh_t* mesh = GetMesh(name);
+	if(mesh)
 	{
-		SetPosition(copy, pos);
+		SetPosition(mesh->root, pos);
 	}
 	else
 	{
@@ -327,6 +798,277 @@ void MoveTo(char* name, vec3_t pos)
 	}
 }
 
+//Packs the transforms of the bodies that moved and refits their bounds, sleeping bodies are not visited.
+void SyncTransforms()
+{
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	for(uint32_t m = 0; m<ent_moved_count; m++)
+	{
+		uint32_t index = ent_moved[m];
+		uint32_t i = ent_slot[index];
+		ent_moved_flag[index] = false;
+		if(i >= ents.count || (ents.handle[i] & ENT_INDEX_MASK) != index)
+		{
+			continue; //despawned after it moved.
+		}
+		motion_pool[index].transform.getOpenGLMatrix(ents.transform[i].mat);
+
+		//the model box rotated into world space, its center is the sphere center.
+		const float* t = ents.transform[i].mat;
+		const mesh_t* mesh = &meshes[ents.mesh[i]];
+		for(int k = 0; k<3; k++)
+		{
+			float center = t[12 + k];
+			float extent = 0.0f;
+			for(int j = 0; j<3; j++)
+			{
+				center += t[j * 4 + k] * mesh->center[j];
+				extent += fabsf(t[j * 4 + k]) * (mesh->maxs[j] - mesh->mins[j]) * 0.5f;
+			}
+			ents.origin[i][k] = t[12 + k];
+			ents.mins[i][k] = center - extent;
+			ents.maxs[i][k] = center + extent;
+			ents.sphere[k][i] = center;
+		}
+		btDbvtVolume volume = EntityVolume(i);
+		scene_tree.update(ents.leaf[i], volume, SCENE_MARGIN);
+	}
+	ent_moved_count = 0;
+	scene_tree.optimizeIncremental(1);
+}
+
+/*
+==============================================================================
+
+					SCENE TREE
+
+A dynamic AABB tree over the entity bounds, separate from the physics
+broadphase, answers the frustum queries of the CPU cull and the physics LOD.
+The descent keeps its own stack, nothing is allocated per query, and a node
+entirely inside the frustum takes its leaves without more plane tests.
+SyncTransforms refits it after every physics step. Leaves are SCENE_MARGIN
+larger than the entity, so a leaf is only moved in the tree once its entity
+leaves them. The 3d thread queries while the main thread refits, every access
+holds scene_mutex.
+==============================================================================
+*/
+
+//Gribb-Hartmann on a column major view projection, the normals point inwards.
+void FrustumPlanes(const float m[16], float planes[6][4])
+{
+	for(int c = 0; c<4; c++)
+	{
+		planes[0][c] = m[c*4 + 3] + m[c*4 + 0];
+		planes[1][c] = m[c*4 + 3] - m[c*4 + 0];
+		planes[2][c] = m[c*4 + 3] + m[c*4 + 1];
+		planes[3][c] = m[c*4 + 3] - m[c*4 + 1];
+		planes[4][c] = m[c*4 + 3] + m[c*4 + 2];
+		planes[5][c] = m[c*4 + 3] - m[c*4 + 2];
+	}
+	for(int p = 0; p<6; p++)
+	{
+		float length = sqrtf(DotProduct(planes[p], planes[p]));
+		for(int c = 0; c<4; c++)
+		{
+			planes[p][c] /= length;
+		}
+	}
+}
+
+//-1 outside a plane, 1 inside every plane, 0 crossing.
+static int ClassifyVolume(const btDbvtVolume& volume, const float planes[6][4])
+{
+	btVector3 center = volume.Center();
+	btVector3 extent = volume.Extents();
+	int result = 1;
+	for(int p = 0; p<6; p++)
+	{
+		float dist = planes[p][0] * center.getX() + planes[p][1] * center.getY() + planes[p][2] * center.getZ() + planes[p][3];
+		float radius = fabsf(planes[p][0]) * extent.getX() + fabsf(planes[p][1]) * extent.getY() + fabsf(planes[p][2]) * extent.getZ();
+		if(dist < -radius)
+		{
+			return -1;
+		}
+		if(dist < radius)
+		{
+			result = 0;
+		}
+	}
+	return result;
+}
+
+//Caller holds scene_mutex, the mutex also guards the static stack.
+static uint32_t CollectFrustum(const float planes[6][4], uint16_t* slots)
+{
+	//depth first, the stack never holds more than one node per leaf.
+	static const btDbvtNode* stack[MAX_ENTITIES + 1];
+	static bool inside[MAX_ENTITIES + 1];
+	if(!scene_tree.m_root)
+	{
+		return 0;
+	}
+	uint32_t count = 0;
+	int top = 0;
+	stack[top] = scene_tree.m_root;
+	inside[top++] = false;
+	while(top)
+	{
+		const btDbvtNode* node = stack[--top];
+		bool in = inside[top];
+		if(!in)
+		{
+			int side = ClassifyVolume(node->volume, planes);
+			if(side < 0)
+			{
+				continue;
+			}
+			in = side > 0;
+		}
+		if(node->isleaf())
+		{
+			slots[count++] = ent_slot[node->dataAsInt];
+			continue;
+		}
+		for(int c = 0; c<2; c++)
+		{
+			stack[top] = node->childs[c];
+			inside[top++] = in;
+		}
+	}
+	return count;
+}
+
+uint32_t QueryFrustum(const float planes[6][4], uint16_t* slots)
+{
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	return CollectFrustum(planes, slots);
+}
+
+/*
+==============================================================================
+
+					BATCHED QUERIES
+
+CastRays runs a batch of rays and sphere sweeps against dynamicsWorld on the
+job pool, CAST_GRAIN queries per chunk. The broadphase keeps a traversal stack
+per thread, so the queries can share the world as long as it is not being
+stepped: call it from the main thread outside StepPhysics.
+==============================================================================
+*/
+
+#define CAST_GRAIN 16
+
+typedef struct
+{
+	const ray_query_t* queries;
+	ray_hit_t* hits;
+} cast_job_t;
+
+static void CastJob(void* data, int begin, int end)
+{
+	cast_job_t* job = (cast_job_t*) data;
+	for(int i = begin; i<end; i++)
+	{
+		const ray_query_t* q = &job->queries[i];
+		ray_hit_t* hit = &job->hits[i];
+		btVector3 from(q->from[0], q->from[1], q->from[2]);
+		btVector3 to(q->to[0], q->to[1], q->to[2]);
+		const btCollisionObject* object = nullptr;
+		btVector3 point, normal;
+		btScalar fraction = 1.0f;
+		if(q->radius <= 0.0f)
+		{
+			btCollisionWorld::ClosestRayResultCallback callback(from, to);
+			callback.m_flags |= btTriangleRaycastCallback::kF_UseGjkConvexCastRaytest;
+			dynamicsWorld->rayTest(from, to, callback);
+			object = callback.m_collisionObject;
+			point = callback.m_hitPointWorld;
+			normal = callback.m_hitNormalWorld;
+			fraction = callback.m_closestHitFraction;
+		}
+		else
+		{
+			btSphereShape sphere(q->radius);
+			btTransform start, end;
+			start.setIdentity();
+			end.setIdentity();
+			start.setOrigin(from);
+			end.setOrigin(to);
+			btCollisionWorld::ClosestConvexResultCallback callback(from, to);
+			dynamicsWorld->convexSweepTest(&sphere, start, end, callback);
+			object = callback.m_hitCollisionObject;
+			point = callback.m_hitPointWorld;
+			normal = callback.m_hitNormalWorld;
+			fraction = callback.m_closestHitFraction;
+		}
+
+		if(!object)
+		{
+			hit->ent = ENT_NONE;
+			hit->fraction = 1.0f;
+			continue;
+		}
+		hit->ent = ent_t(object->getUserIndex());
+		hit->fraction = fraction;
+		for(int k = 0; k<3; k++)
+		{
+			hit->point[k] = point[k];
+			hit->normal[k] = normal[k];
+		}
+	}
+}
+
+//hits[i] answers queries[i], the closest hit along the query wins.
+void CastRays(const ray_query_t* queries, ray_hit_t* hits, uint32_t count)
+{
+	CPU_SCOPE("CastRays");
+	cast_job_t job = {queries, hits};
+	jobs::ParallelFor(0, int(count), CAST_GRAIN, CastJob, &job);
+}
+
+//Returns the number of visible entities. Without the cull cvar every entity is visible.
+//The lock is held throughout, a Spawn or Despawn in between would move the counted slots.
+uint32_t CullEntities(float mvp[16])
+{
+	CPU_SCOPE("CullEntities");
+	std::lock_guard<std::mutex> lock(scene_mutex);
+	uint32_t visible;
+	if(cull.value)
+	{
+		float planes[6][4];
+		FrustumPlanes(mvp, planes);
+		visible = CollectFrustum(planes, ent_visible);
+	}
+	else
+	{
+		visible = ents.count;
+		for(uint32_t i = 0; i<visible; i++)
+		{
+			ent_visible[i] = i;
+		}
+	}
+
+	uint32_t count[MAX_MESHES] = {};
+	for(uint32_t v = 0; v<visible; v++)
+	{
+		count[ents.mesh[ent_visible[v]]]++;
+	}
+	uint32_t next = 0;
+	for(uint32_t m = 0; m<mesh_count; m++)
+	{
+		meshes[m].first_instance = next;
+		meshes[m].instance_count = 0;
+		next += count[m];
+	}
+	for(uint32_t v = 0; v<visible; v++)
+	{
+		uint32_t i = ent_visible[v];
+		mesh_t* mesh = &meshes[ents.mesh[i]];
+		instances.model[mesh->first_instance + mesh->instance_count++] = ents.transform[i];
+	}
+	return visible;
+}
+
 
 	btVector3 GetRayTo(int x, int y)
 	{
@@ -383,16 +1125,19 @@ void MoveTo(char* name, vec3_t pos)
 
 	bool PickBody(const btVector3& rayFromWorld, const btVector3& rayToWorld)
 	{
+		float from[3] = {rayFromWorld.getX(), rayFromWorld.getY(), rayFromWorld.getZ()};
+		float to[3] = {rayToWorld.getX(), rayToWorld.getY(), rayToWorld.getZ()};
+		RecordInput(INPUT_PICK, 0, from, to);
 		p("From %f %f %f", rayFromWorld.getX(), rayFromWorld.getY(), rayFromWorld.getZ());
 		p("To %f %f %f", rayToWorld.getX(), rayToWorld.getY(), rayToWorld.getZ());
-		btCollisionWorld::ClosestRayResultCallback rayCallback(rayFromWorld, rayToWorld);
-
-		rayCallback.m_flags |= btTriangleRaycastCallback::kF_UseGjkConvexCastRaytest;
-		dynamicsWorld->rayTest(rayFromWorld, rayToWorld, rayCallback);
-		if (rayCallback.hasHit())
+		ray_query_t query = {{rayFromWorld.getX(), rayFromWorld.getY(), rayFromWorld.getZ()},
+		                     {rayToWorld.getX(), rayToWorld.getY(), rayToWorld.getZ()}, 0.0f};
+		ray_hit_t hit;
+		CastRays(&query, &hit, 1);
+		if (hit.ent != ENT_NONE)
 		{
-			btVector3 pickPos = rayCallback.m_hitPointWorld;
-			btRigidBody* body = (btRigidBody*)btRigidBody::upcast(rayCallback.m_collisionObject);
+			btVector3 pickPos(hit.point[0], hit.point[1], hit.point[2]);
+			btRigidBody* body = Body(hit.ent);
 			if (body)
 			{
 				//other exclusions?
@@ -430,6 +1175,9 @@ void MoveTo(char* name, vec3_t pos)
 	{
 		if (m_pickedBody && m_pickedConstraint)
 		{
+			float from[3] = {rayFromWorld.getX(), rayFromWorld.getY(), rayFromWorld.getZ()};
+			float to[3] = {rayToWorld.getX(), rayToWorld.getY(), rayToWorld.getZ()};
+			RecordInput(INPUT_DRAG, 0, from, to);
 			btPoint2PointConstraint* pickCon = static_cast<btPoint2PointConstraint*>(m_pickedConstraint);
 			if (pickCon)
 			{
@@ -453,6 +1201,7 @@ void RemovePickingConstraint()
 {
 	if (m_pickedConstraint)
 		{
+			RecordInput(INPUT_RELEASE, 0, nullptr, nullptr);
 			m_pickedBody->forceActivationState(m_savedState);
 			m_pickedBody->activate();
 			dynamicsWorld->removeConstraint(m_pickedConstraint);
@@ -461,24 +1210,805 @@ void RemovePickingConstraint()
 			m_pickedBody = 0;
 		}
 }
+/*
+==============================================================================
+
+					MULTITHREADED WORLD
+
+physics_threads > 0 swaps the world for a btDiscreteDynamicsWorldMt, Bullet's
+parallel loops are handed to the job pool through JobTaskScheduler. The count
+includes the main thread, which runs its share of every loop. It only caps the
+workers a loop takes, the pool is sized once at startup and shared with
+CastRays.
+==============================================================================
+*/
+
+typedef struct
+{
+	const btIParallelSumBody* body;
+	btScalar sum;
+	std::mutex lock;
+} job_sum_t;
+
+static void ForJob(void* data, int begin, int end)
+{
+	((const btIParallelForBody*) data)->forLoop(begin, end);
+}
+
+static void SumJob(void* data, int begin, int end)
+{
+	job_sum_t* s = (job_sum_t*) data;
+	btScalar sum = s->body->sumLoop(begin, end);
+	std::lock_guard<std::mutex> lk(s->lock);
+	s->sum += sum;
+}
+
+//setNumThreads only limits the workers Bullet's loops use, the pool is shared with CastRays.
+class JobTaskScheduler : public btITaskScheduler
+{
+public:
+	JobTaskScheduler() : btITaskScheduler("jobs"), workers(0) {}
+	virtual int getMaxNumThreads() const BT_OVERRIDE { return JOBS_MAX_THREADS + 1; }
+	virtual int getNumThreads() const BT_OVERRIDE { return q_min(workers, jobs::Threads()) + 1; }
+	virtual void setNumThreads(int numThreads) BT_OVERRIDE { workers = q_max(numThreads - 1, 0); }
+	virtual void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody& body) BT_OVERRIDE
+	{
+		jobs::ParallelFor(iBegin, iEnd, grainSize, ForJob, (void*) &body, workers);
+	}
+	virtual btScalar parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody& body) BT_OVERRIDE
+	{
+		job_sum_t s;
+		s.body = &body;
+		s.sum = btScalar(0);
+		jobs::ParallelFor(iBegin, iEnd, grainSize, SumJob, &s, workers);
+		return s.sum;
+	}
+private:
+	int workers;
+};
+static JobTaskScheduler job_scheduler;
+
+//Axis sweep quantizes against fixed bounds: the scene bounds grown by half their size, or
+//PHYSICS_WORLD_EXTENT around the origin while the scene is empty.
+static void WorldBounds(btVector3& mins, btVector3& maxs)
+{
+	mins = btVector3(-PHYSICS_WORLD_EXTENT, -PHYSICS_WORLD_EXTENT, -PHYSICS_WORLD_EXTENT);
+	maxs = -mins;
+	if(!ents.count)
+	{
+		return;
+	}
+	mins = btVector3(ents.mins[0][0], ents.mins[0][1], ents.mins[0][2]);
+	maxs = btVector3(ents.maxs[0][0], ents.maxs[0][1], ents.maxs[0][2]);
+	for(uint32_t i = 1; i<ents.count; i++)
+	{
+		mins.setMin(btVector3(ents.mins[i][0], ents.mins[i][1], ents.mins[i][2]));
+		maxs.setMax(btVector3(ents.maxs[i][0], ents.maxs[i][1], ents.maxs[i][2]));
+	}
+	btVector3 pad = (maxs - mins) * 0.5f;
+	pad.setMax(btVector3(PHYSICS_BOUNDS_PAD, PHYSICS_BOUNDS_PAD, PHYSICS_BOUNDS_PAD));
+	mins -= pad;
+	maxs += pad;
+}
+
+//Cvar callback, dbvt tuning applies to the live broadphase.
+void TuneBroadphase(struct cvar_s* var)
+{
+	if(broadphase && broadphase_type == BROADPHASE_DBVT)
+	{
+		btDbvtBroadphase* dbvt = (btDbvtBroadphase*) broadphase;
+		dbvt->m_deferedcollide = physics_dbvt_deferred.value != 0.0f;
+		dbvt->setVelocityPrediction(physics_dbvt_prediction.value);
+	}
+}
+
+static void CreateBroadphase(int type)
+{
+	btVector3 mins, maxs;
+	broadphase_type = q_max(q_min(type, BROADPHASE_SWEEP32), 0);
+	switch(broadphase_type)
+	{
+		case BROADPHASE_SWEEP:
+			WorldBounds(mins, maxs);
+			broadphase = new btAxisSweep3(mins, maxs, MAX_ENTITIES + 1);
+			break;
+		case BROADPHASE_SWEEP32:
+			WorldBounds(mins, maxs);
+			broadphase = new bt32BitAxisSweep3(mins, maxs, MAX_ENTITIES + 1);
+			break;
+		default:
+			broadphase = new btDbvtBroadphase();
+			TuneBroadphase(nullptr);
+			return;
+	}
+	info("Axis sweep bounds %.1f %.1f %.1f to %.1f %.1f %.1f.", mins.getX(), mins.getY(), mins.getZ(),
+	     maxs.getX(), maxs.getY(), maxs.getZ());
+}
+
+//collisionConfiguration is shared by every kind of world.
+static void CreateWorld(int threads)
+{
+	CreateBroadphase((int) physics_broadphase.value);
+	threads = q_max(q_min(threads, job_scheduler.getMaxNumThreads()), 0);
+	if(threads)
+	{
+		//btSetTaskScheduler has to come from the main thread, Bullet's thread index 0.
+		job_scheduler.setNumThreads(threads);
+		btSetTaskScheduler(&job_scheduler);
+		dispatcher = new btCollisionDispatcherMt(collisionConfiguration, 40);
+		solver = new btSequentialImpulseConstraintSolverMt();
+		solver_pool = new btConstraintSolverPoolMt(threads);
+		dynamicsWorld = new btDiscreteDynamicsWorldMt(dispatcher, broadphase, solver_pool, solver, collisionConfiguration);
+	}
+	else
+	{
+		dispatcher = new btCollisionDispatcher(collisionConfiguration);
+		solver = new btSequentialImpulseConstraintSolver();
+		dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
+	}
+	btGImpactCollisionAlgorithm::registerAlgorithm(dispatcher);
+	info("Physics world runs on %d thread(s) over the %s broadphase.", q_max(threads, 1), broadphase_names[broadphase_type]);
+}
+
+//Tears the world down and builds it again around bodies, added in the given order. Nothing of
+//the old broadphase, manifolds or solver seed survives, which a deterministic replay relies on.
+static void RebuildWorld(int threads, btRigidBody** bodies, uint32_t count)
+{
+	RemovePickingConstraint();
+	btVector3 gravity = dynamicsWorld->getGravity();
+	for(uint32_t i = 0; i<ents.count; i++)
+	{
+		if(ents.body[i]->isInWorld())
+		{
+			dynamicsWorld->removeRigidBody(ents.body[i]);
+		}
+	}
+	delete dynamicsWorld;
+	delete solver_pool;
+	delete solver;
+	delete dispatcher;
+	delete broadphase;
+	solver_pool = nullptr;
+
+	CreateWorld(threads);
+	dynamicsWorld->setGravity(gravity);
+	for(uint32_t i = 0; i<count; i++)
+	{
+		dynamicsWorld->addRigidBody(bodies[i]);
+	}
+}
+
+//Cvar callback for physics_threads and physics_broadphase, rebuilds the world around the existing bodies.
+void PhysicsThreads(struct cvar_s* var)
+{
+	if(!dynamicsWorld)
+	{
+		return; //InitPhysics reads the cvar.
+	}
+	RebuildWorld((int) physics_threads.value, ents.body, ents.count);
+}
+
+/*
+==============================================================================
+
+					SNAPSHOTS
+
+physics_snapshot keeps the state of every body in memory and dumps the world
+through btDefaultSerializer to ./physics.bullet for offline inspection.
+physics_rollback puts the bodies back: entities spawned since are despawned,
+the ones despawned since come back under a new handle.
+==============================================================================
+*/
+
+typedef struct
+{
+	ent_t handle;
+	uint16_t mesh;
+	int activation;
+	float deactivation;
+	btTransformFloatData transform;
+	btVector3FloatData linear;
+	btVector3FloatData angular;
+} body_snapshot_t;
+
+static body_snapshot_t snapshot[MAX_ENTITIES];
+static uint32_t snapshot_count = 0;
+
+static void SaveWorld(const char* path)
+{
+	btDefaultSerializer* serializer = new btDefaultSerializer();
+	dynamicsWorld->serialize(serializer);
+	FILE* file = fopen(path, "wb");
+	if(!file)
+	{
+		error("Could not open %s", path);
+		delete serializer;
+		return;
+	}
+	fwrite(serializer->getBufferPointer(), serializer->getCurrentBufferSize(), 1, file);
+	fclose(file);
+	info("Physics world written to %s, %d bytes.", path, serializer->getCurrentBufferSize());
+	delete serializer;
+}
+
+static void TakeSnapshot()
+{
+	for(uint32_t i = 0; i<ents.count; i++)
+	{
+		btRigidBody* body = ents.body[i];
+		body_snapshot_t* s = &snapshot[i];
+		s->handle = ents.handle[i];
+		s->mesh = ents.mesh[i];
+		s->activation = body->getActivationState();
+		s->deactivation = body->getDeactivationTime();
+		body->getWorldTransform().serializeFloat(s->transform);
+		body->getLinearVelocity().serializeFloat(s->linear);
+		body->getAngularVelocity().serializeFloat(s->angular);
+	}
+	snapshot_count = ents.count;
+}
+
+//Cvar callback, any new value takes a snapshot.
+void Snapshot(struct cvar_s* var)
+{
+	//the recording's start state lives in snapshot until WriteReplay.
+	if(recording)
+	{
+		warn("Stop the recording before a snapshot.");
+		return;
+	}
+	CPU_SCOPE("Snapshot");
+	TakeSnapshot();
+	info("Physics snapshot of %u bodies.", snapshot_count);
+	SaveWorld("./physics.bullet");
+}
+
+//Back at full detail, a snapshot does not keep what the physics LOD changed.
+static void ClearLod(uint32_t slot)
+{
+	btRigidBody* body = ents.body[slot];
+	if(!body->isInWorld())
+	{
+		dynamicsWorld->addRigidBody(body);
+	}
+	body->setSleepingThresholds(PHYSICS_SLEEP_LINEAR, PHYSICS_SLEEP_ANGULAR);
+	ent_frozen[ents.handle[slot] & ENT_INDEX_MASK] = false;
+}
+
+static void RestoreSnapshot()
+{
+	RemovePickingConstraint();
+
+	//a live entity is kept for the first entry that names it with the same mesh, a log from
+	//another session may name entities that now hold something else.
+	static uint32_t owner[MAX_ENTITIES]; //index -> entry + 1.
+	zone::Q_memset(owner, 0, sizeof(owner));
+	for(uint32_t s = 0; s<snapshot_count; s++)
+	{
+		int slot = Slot(snapshot[s].handle);
+		uint32_t index = snapshot[s].handle & ENT_INDEX_MASK;
+		if(slot >= 0 && ents.mesh[slot] == snapshot[s].mesh && !owner[index])
+		{
+			owner[index] = s + 1;
+		}
+	}
+	//backwards, Despawn moves the last slot into the freed one.
+	for(int i = int(ents.count) - 1; i>=0; i--)
+	{
+		if(!owner[ents.handle[i] & ENT_INDEX_MASK])
+		{
+			Despawn(ents.handle[i]);
+		}
+	}
+
+	for(uint32_t s = 0; s<snapshot_count; s++)
+	{
+		body_snapshot_t* snap = &snapshot[s];
+		if(Slot(snap->handle) < 0 || owner[snap->handle & ENT_INDEX_MASK] != s + 1)
+		{
+			mesh_t* mesh = &meshes[snap->mesh];
+			ent_t ent = Spawn(mesh);
+			if(mesh->root == snap->handle)
+			{
+				mesh->root = ent;
+			}
+			snap->handle = ent;
+		}
+		int slot = Slot(snap->handle);
+		if(slot < 0)
+		{
+			continue;
+		}
+		ClearLod(slot); //a parked body has no broadphase proxy for updateSingleAabb.
+		btRigidBody* body = ents.body[slot];
+		btTransform transform;
+		btVector3 linear, angular;
+		transform.deSerializeFloat(snap->transform);
+		linear.deSerializeFloat(snap->linear);
+		angular.deSerializeFloat(snap->angular);
+		body->setCenterOfMassTransform(transform);
+		body->setInterpolationWorldTransform(transform);
+		body->getMotionState()->setWorldTransform(transform);
+		body->setLinearVelocity(linear);
+		body->setAngularVelocity(angular);
+		body->setInterpolationLinearVelocity(linear);
+		body->setInterpolationAngularVelocity(angular);
+		body->clearForces();
+		body->forceActivationState(snap->activation);
+		body->setDeactivationTime(snap->deactivation);
+		dynamicsWorld->updateSingleAabb(body);
+	}
+	SyncTransforms();
+}
+
+//Cvar callback, any new value rolls back to the last snapshot.
+void Rollback(struct cvar_s* var)
+{
+	if(recording)
+	{
+		warn("Stop the recording before a rollback.");
+		return;
+	}
+	if(!snapshot_count)
+	{
+		warn("No physics snapshot to roll back to.");
+		return;
+	}
+	CPU_SCOPE("Rollback");
+	RestoreSnapshot();
+	info("Rolled back to the physics snapshot of %u bodies.", snapshot_count);
+}
+
+/*
+==============================================================================
+
+					FIXED STEP AND REPLAY
+
+physics_hz > 0 steps the world in fixed ticks of 1 / physics_hz seconds, at
+most physics_substeps of them per frame, time beyond that is dropped. Every
+tick is its own stepSimulation call, so a tick does the same work whatever
+the frame rate was.
+physics_record 1 takes a snapshot, rebuilds the world from it and logs each
+input that reaches the physics with the tick it lands before. physics_record 0
+writes the snapshot, the inputs and a hash of the final state to
+./physics_replay.log. Any new physics_replay value runs that log without
+drawing, as fast as the cpu allows, and reports the time per tick and whether
+the hash matched. Replays are bit exact only on the single threaded world.
+==============================================================================
+*/
+
+static void ApplyInput(const input_event_t* e)
+{
+	btVector3 from(e->a[0], e->a[1], e->a[2]);
+	btVector3 to(e->b[0], e->b[1], e->b[2]);
+	switch(e->type)
+	{
+		case INPUT_LAUNCH:
+			Launch((e->mesh < mesh_count) ? &meshes[e->mesh] : nullptr, e->a, e->b);
+			break;
+		case INPUT_PICK:
+			PickBody(from, to);
+			break;
+		case INPUT_DRAG:
+			MovePickedBody(from, to);
+			break;
+		case INPUT_RELEASE:
+			RemovePickingConstraint();
+			break;
+	}
+}
+
+//FNV-1a over the state of every body, in world order.
+static uint64_t WorldHash()
+{
+	uint64_t hash = 14695981039346656037ull;
+	const btCollisionObjectArray& objects = dynamicsWorld->getCollisionObjectArray();
+	for(int i = 0; i<objects.size(); i++)
+	{
+		btRigidBody* body = btRigidBody::upcast(objects[i]);
+		if(!body)
+		{
+			continue;
+		}
+		btTransformFloatData transform;
+		btVector3FloatData velocity[2];
+		zone::Q_memset(&transform, 0, sizeof(transform));
+		zone::Q_memset(velocity, 0, sizeof(velocity));
+		body->getWorldTransform().serializeFloat(transform);
+		body->getLinearVelocity().serializeFloat(velocity[0]);
+		body->getAngularVelocity().serializeFloat(velocity[1]);
+		const unsigned char* bytes[2] = {(const unsigned char*) &transform, (const unsigned char*) velocity};
+		size_t sizes[2] = {sizeof(transform), sizeof(velocity)};
+		for(int k = 0; k<2; k++)
+		{
+			for(size_t b = 0; b<sizes[k]; b++)
+			{
+				hash = (hash ^ bytes[k][b]) * 1099511628211ull;
+			}
+		}
+	}
+	return hash;
+}
+
+//Rebuilds the world with the snapshot bodies in snapshot order, recording and replay start alike.
+static void ResetToSnapshot()
+{
+	std::vector<btRigidBody*> bodies(snapshot_count);
+	for(uint32_t s = 0; s<snapshot_count; s++)
+	{
+		bodies[s] = Body(snapshot[s].handle);
+	}
+	RebuildWorld((int) physics_threads.value, bodies.data(), snapshot_count);
+	for(uint32_t i = 0; i<ents.count; i++)
+	{
+		ClearLod(i);
+	}
+	physics_accum = 0.0;
+	physics_tick = 0;
+	if(physics_threads.value)
+	{
+		warn("The multithreaded world does not replay bit exact.");
+	}
+}
+
+static void Tick(float step)
+{
+	dynamicsWorld->stepSimulation(step, 0);
+	physics_tick++;
+}
+
+static void WriteReplay(const char* path)
+{
+	FILE* file = fopen(path, "wb");
+	if(!file)
+	{
+		error("Could not open %s", path);
+		return;
+	}
+	replay_header_t header = {REPLAY_MAGIC, REPLAY_VERSION, physics_hz.value, physics_tick,
+	                          snapshot_count, uint32_t(input_log.size()), WorldHash()};
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(snapshot, sizeof(body_snapshot_t), snapshot_count, file);
+	fwrite(input_log.data(), sizeof(input_event_t), input_log.size(), file);
+	fclose(file);
+	info("Recorded %u ticks and %u inputs to %s.", header.ticks, header.events, path);
+}
+
+//Cvar callback, 1 starts a recording, 0 ends it and writes the log.
+void PhysicsRecord(struct cvar_s* var)
+{
+	if(var->value && !recording)
+	{
+		if(physics_hz.value <= 0.0f)
+		{
+			warn("physics_record needs a fixed step, physics_hz is set to 60.");
+			Cvar_SetQuick(&physics_hz, "60");
+		}
+		TakeSnapshot();
+		ResetToSnapshot();
+		input_log.clear();
+		recording = true;
+		info("Recording physics at %g Hz.", physics_hz.value);
+	}
+	else if(!var->value && recording)
+	{
+		recording = false;
+		WriteReplay("./physics_replay.log");
+	}
+}
+
+//Cvar callback, any new value replays ./physics_replay.log.
+void PhysicsReplay(struct cvar_s* var)
+{
+	if(recording)
+	{
+		warn("Stop the recording before a replay.");
+		return;
+	}
+	FILE* file = fopen("./physics_replay.log", "rb");
+	if(!file)
+	{
+		error("Could not open ./physics_replay.log");
+		return;
+	}
+	fseek(file, 0, SEEK_END);
+	uint64_t length = uint64_t(ftell(file));
+	fseek(file, 0, SEEK_SET);
+
+	//the counts have to add up to the file length before anything is sized from them.
+	replay_header_t header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == REPLAY_MAGIC &&
+	             header.version == REPLAY_VERSION && header.bodies <= MAX_ENTITIES && header.hz > 0.0f &&
+	             length == sizeof(header) + uint64_t(header.bodies) * sizeof(body_snapshot_t) +
+	                       uint64_t(header.events) * sizeof(input_event_t);
+	std::vector<input_event_t> events;
+	if(valid)
+	{
+		events.resize(header.events);
+		valid = fread(snapshot, sizeof(body_snapshot_t), header.bodies, file) == header.bodies &&
+		        fread(events.data(), sizeof(input_event_t), header.events, file) == header.events;
+	}
+	fclose(file);
+	for(uint32_t s = 0; valid && s<header.bodies; s++)
+	{
+		valid = snapshot[s].mesh < mesh_count;
+	}
+	if(!valid)
+	{
+		snapshot_count = 0;
+		error("./physics_replay.log is not a physics replay.");
+		return;
+	}
+
+	CPU_SCOPE("PhysicsReplay");
+	snapshot_count = header.bodies;
+	RestoreSnapshot();
+	ResetToSnapshot();
+	float step = 1.0f / header.hz;
+	uint32_t next = 0;
+	uint64_t begin = profiler::CpuNow();
+	for(uint32_t t = 0; t<header.ticks; t++)
+	{
+		for(; next < events.size() && events[next].tick == t; next++)
+		{
+			ApplyInput(&events[next]);
+		}
+		Tick(step);
+	}
+	//inputs of frames that ended between two ticks are already part of the recorded hash.
+	for(; next < events.size() && events[next].tick == header.ticks; next++)
+	{
+		ApplyInput(&events[next]);
+	}
+	double ms = double(profiler::CpuNow() - begin) * 1e-6;
+	uint64_t hash = WorldHash();
+	SyncTransforms();
+	info("Replayed %u ticks in %.2f ms, %.4f ms per tick. The final state %s.", header.ticks, ms,
+	     header.ticks ? ms / header.ticks : 0.0, hash == header.hash ? "matches" : "does NOT match");
+}
+
+/*
+==============================================================================
+
+					PHYSICS LOD
+
+With physics_lod set, every frame re-grades PHYSICS_LOD_BATCH bodies by their
+distance to the camera and whether the scene tree finds them in view:
+near	default sleeping thresholds.
+far	in view past physics_lod_near, thresholds raised by physics_lod_sleep so
+	the body settles sooner.
+frozen	out of view past physics_lod_near, a moving body is put to sleep and
+	woken with its old velocity once it is graded near or far. Contacts with
+	awake bodies wake it as well.
+out	past physics_lod_active, the body leaves the world and is added back once
+	the sweep finds it inside the radius again.
+Out bodies still draw and keep their place in the scene tree, but CastRays
+does not see them. Bullet solver iterations are global, so the LOD works
+through sleeping and world membership only. The sweep pauses while a replay
+is recorded, the replay would otherwise depend on the camera. A rollback or
+a replay puts every body back at full detail.
+==============================================================================
+*/
+
+typedef enum
+{
+	LOD_NEAR,
+	LOD_FAR,
+	LOD_FROZEN,
+	LOD_OUT
+} lod_t;
+
+static lod_t GradeBody(uint32_t slot, bool in_world)
+{
+	float d = 0.0f;
+	for(int k = 0; k<3; k++)
+	{
+		float delta = ents.sphere[k][slot] - cam.pos[k];
+		d += delta * delta;
+	}
+	float radius = ents.sphere[3][slot];
+	d = sqrtf(d) - radius;
+
+	//hysteresis, so a body on the edge is not added and removed every sweep.
+	float active = physics_lod_active.value * (in_world ? PHYSICS_LOD_HYSTERESIS : 1.0f);
+	if(physics_lod_active.value > 0.0f && d > active)
+	{
+		return LOD_OUT;
+	}
+	if(d < physics_lod_near.value)
+	{
+		return LOD_NEAR;
+	}
+	return (lod_seen[slot] == lod_frame) ? LOD_FAR : LOD_FROZEN;
+}
+
+static void ApplyLod(uint32_t slot, lod_t lod)
+{
+	btRigidBody* body = ents.body[slot];
+	uint32_t index = ents.handle[slot] & ENT_INDEX_MASK;
+	if(lod == LOD_OUT)
+	{
+		if(body->isInWorld())
+		{
+			dynamicsWorld->removeRigidBody(body);
+		}
+		return;
+	}
+	if(!body->isInWorld())
+	{
+		dynamicsWorld->addRigidBody(body);
+	}
+
+	float scale = (lod == LOD_NEAR) ? 1.0f : q_max(physics_lod_sleep.value, 1.0f);
+	body->setSleepingThresholds(PHYSICS_SLEEP_LINEAR * scale, PHYSICS_SLEEP_ANGULAR * scale);
+	if(lod == LOD_FROZEN)
+	{
+		if(body->getActivationState() == ACTIVE_TAG)
+		{
+			frozen_velocity[index][0] = body->getLinearVelocity();
+			frozen_velocity[index][1] = body->getAngularVelocity();
+			body->forceActivationState(ISLAND_SLEEPING);
+			ent_frozen[index] = true;
+		}
+	}
+	else if(ent_frozen[index])
+	{
+		//a contact that woke it first already decided its velocity.
+		ent_frozen[index] = false;
+		if(body->getActivationState() == ISLAND_SLEEPING)
+		{
+			body->activate(true);
+			body->setLinearVelocity(frozen_velocity[index][0]);
+			body->setAngularVelocity(frozen_velocity[index][1]);
+		}
+	}
+}
+
+//Main thread before the workers run, Main3DThread rewrites cam.mvp.
+void UpdateLod()
+{
+	if(!physics_lod.value || recording || !ents.count)
+	{
+		return;
+	}
+	CPU_SCOPE("UpdateLod");
+	static uint16_t in_view[MAX_ENTITIES];
+	float planes[6][4];
+	FrustumPlanes(cam.mvp, planes);
+	uint32_t visible = QueryFrustum(planes, in_view);
+	lod_frame++;
+	for(uint32_t v = 0; v<visible; v++)
+	{
+		lod_seen[in_view[v]] = lod_frame;
+	}
+
+	uint32_t batch = q_min(ents.count, uint32_t(PHYSICS_LOD_BATCH));
+	for(uint32_t b = 0; b<batch; b++)
+	{
+		uint32_t slot = lod_cursor++ % ents.count;
+		btRigidBody* body = ents.body[slot];
+		if(body->isStaticObject() || body == m_pickedBody)
+		{
+			continue;
+		}
+		ApplyLod(slot, GradeBody(slot, body->isInWorld()));
+	}
+	lod_cursor %= ents.count;
+}
+
+//Cvar callback, turning the LOD off brings every body back at full detail.
+void PhysicsLod(struct cvar_s* var)
+{
+	if(var->value || !dynamicsWorld)
+	{
+		return;
+	}
+	for(uint32_t i = 0; i<ents.count; i++)
+	{
+		if(!ents.body[i]->isStaticObject())
+		{
+			ApplyLod(i, LOD_NEAR);
+		}
+	}
+}
+
 void InitPhysics()
 {
 	btAlignedAllocSetCustom((btAllocFunc*) Bt_alloc, (btFreeFunc*) Bt_free);
-	broadphase = new btDbvtBroadphase();
 	collisionConfiguration = new btDefaultCollisionConfiguration();
-	dispatcher = new btCollisionDispatcher(collisionConfiguration);
+	CreateWorld((int) physics_threads.value);
+	body_pool = (btRigidBody*) zone::Hunk_AllocName(MAX_ENTITIES * sizeof(btRigidBody), "body_pool");
+	motion_pool = (EntMotionState*) zone::Hunk_AllocName(MAX_ENTITIES * sizeof(EntMotionState), "motion_pool");
 
-	btGImpactCollisionAlgorithm::registerAlgorithm(dispatcher);
+	dynamicsWorld->setGravity(btVector3(0, 0, 0));
+}
 
-	solver = new btSequentialImpulseConstraintSolver();
-	dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
+//Cvar callback, routes Bullet's BT_PROFILE zones into the profiler.
+void PhysicsProfile(struct cvar_s* var)
+{
+	static btEnterProfileZoneFunc* enter = btGetCurrentEnterProfileZoneFunc();
+	static btLeaveProfileZoneFunc* leave = btGetCurrentLeaveProfileZoneFunc();
+	btSetCustomEnterProfileZoneFunc(var->value ? profiler::PhysicsEnter : enter);
+	btSetCustomLeaveProfileZoneFunc(var->value ? profiler::PhysicsLeave : leave);
+}
 
-	dynamicsWorld->setGravity(btVector3(0, 0, 0));
+static void PhysicsCounters(physics_frame_t* frame)
+{
+	frame->bodies = dynamicsWorld->getNumCollisionObjects();
+	frame->broadphase = broadphase_names[broadphase_type];
+	frame->pairs = broadphase->getOverlappingPairCache()->getNumOverlappingPairs();
+	//the broadphase update is the bounds refit plus the pair search.
+	frame->broadphase_ms = 0.0;
+	for(int i = 0; i<frame->zone_count; i++)
+	{
+		if(!zone::Q_strcmp(frame->zones[i].name, "updateAabbs") || !zone::Q_strcmp(frame->zones[i].name, "calculateOverlappingPairs"))
+		{
+			frame->broadphase_ms += frame->zones[i].ms;
+		}
+	}
+	frame->manifolds = dispatcher->getNumManifolds();
+	frame->contacts = 0;
+	for(int i = 0; i<frame->manifolds; i++)
+	{
+		frame->contacts += dispatcher->getManifoldByIndexInternal(i)->getNumContacts();
+	}
+
+	//awake bodies that share an island tag are solved together.
+	std::vector<bool> island(frame->bodies, false);
+	frame->awake = 0;
+	frame->islands = 0;
+	frame->parked = 0;
+	for(uint32_t i = 0; i<ents.count; i++)
+	{
+		btRigidBody* body = ents.body[i];
+		if(!body->isInWorld())
+		{
+			frame->parked++;
+			continue;
+		}
+		if(body->isStaticObject() || !body->isActive())
+		{
+			continue;
+		}
+		frame->awake++;
+		int tag = body->getIslandTag();
+		if(tag >= 0 && tag < frame->bodies && !island[tag])
+		{
+			island[tag] = true;
+			frame->islands++;
+		}
+	}
 }
 
 void StepPhysics()
 {
-	dynamicsWorld->stepSimulation(frametime, 0);
+	CPU_SCOPE("StepPhysics");
+	bool profile = physics_profile.value != 0.0f;
+	if(profile)
+	{
+		profiler::PhysicsBeginStep();
+	}
+	if(physics_hz.value > 0.0f)
+	{
+		float step = 1.0f / physics_hz.value;
+		int substeps = q_max(int(physics_substeps.value), 1);
+		physics_accum += frametime;
+		for(int i = 0; i<substeps && physics_accum >= step; i++)
+		{
+			Tick(step);
+			physics_accum -= step;
+		}
+		physics_accum = fmod(physics_accum, double(step));
+	}
+	else
+	{
+		dynamicsWorld->stepSimulation(frametime, 0);
+	}
+	if(profile)
+	{
+		PhysicsCounters(profiler::PhysicsEndStep());
+		profiler::PhysicsPublish();
+	}
+	SyncTransforms();
 }
-
 } //namespace entity
@@ -35,10 +35,14 @@ typedef struct ui_ent_t
 {
 	VkBuffer buffer[2];
 	VkDeviceSize buffer_offset[2];
+	VkDeviceMemory memory;
+	unsigned char* mapped;
 	unsigned char* vertex_data;
-	uint32_t* index_data;
-	int buffer_size;
+	uint16_t* index_data;
+	int buffer_size; //quads per frame.
 	int buf_idx;
+	int frame;
+	bool overflow;
 } ui_ent_t;
 
 typedef struct basic_ent_t
@@ -71,31 +75,118 @@ typedef struct sky_ent_t
 } sky_ent_t;
 
 
-typedef struct mesh_ent_t
+//-----------------------------------
+#define MAX_ENTITIES 4096 //must fit in ENT_INDEX_BITS.
+#define MAX_MESHES 32
+#define MESH_HASH_SIZE 64 //open addressing, power of two and at least twice MAX_MESHES.
+#define ENT_INDEX_BITS 16
+#define ENT_INDEX_MASK ((1u << ENT_INDEX_BITS) - 1)
+#define ENT_NONE 0 //generations start at 1, no live entity has this handle.
+#define INSTANCE_IDENTITY MAX_ENTITIES //instance slot for draws that are not entities.
+#define SCENE_MARGIN 0.5f //scene tree leaves are this much larger than their entity.
+#define COLLISION_HULL_INDICES 384 //simplification target before a convex hull is taken.
+#define COLLISION_HULL_ERROR 0.05f //meshopt_simplify error bound, relative to the mesh extent.
+#define ENT_MASS 100.0f //every movable entity weighs the same for now.
+#define PHYSICS_WORLD_EXTENT 1000.0f //axis sweep bounds while the scene is empty.
+#define PHYSICS_BOUNDS_PAD 50.0f //least room around the scene for the axis sweep.
+#define PHYSICS_LOD_BATCH 512 //bodies the LOD sweep grades per frame.
+#define PHYSICS_LOD_HYSTERESIS 1.1f //an out body comes back inside physics_lod_active, leaves past this much more.
+#define PHYSICS_SLEEP_LINEAR 0.8f //Bullet's default sleeping thresholds.
+#define PHYSICS_SLEEP_ANGULAR 1.0f
+//-----------------------------------
+
+//physics_broadphase values.
+enum
+{
+	BROADPHASE_DBVT, //dynamic trees, no bounds, best when much moves.
+	BROADPHASE_SWEEP, //16 bit sort and sweep inside the world bounds, for mostly static scenes.
+	BROADPHASE_SWEEP32 //32 bit, for large bounds.
+};
+
+//How a mesh is turned into a collision shape when it is loaded.
+typedef enum
+{
+	COLLISION_SPHERE, //bounding sphere, the cheapest.
+	COLLISION_HULL, //convex hull of the simplified mesh, movable.
+	COLLISION_MESH //bvh over the render triangles, static only.
+} collision_t;
+
+//generation << ENT_INDEX_BITS | index. A handle goes stale once its entity is despawned.
+typedef uint32_t ent_t;
+
+//Render and collision data shared by every entity spawned from one asset.
+typedef struct mesh_t
 {
 	char* name;
-	fastObjMesh* obj;
-	VkBuffer buffer[4];
+	uint32_t name_hash;
+	VkBuffer buffer[2];
 	VkDeviceSize buffer_offset[2];
-	VkDescriptorSet dset[2];
-	uint32_t uniform_offset[2];
-	UniformMatrix* mat;
 	unsigned char* vertex_data;
 	uint32_t* index_data;
 	uint32_t vertex_count;
 	uint32_t index_count;
-	float scale;
-	btTriangleMesh* collisionMesh;
-	btGImpactMeshShape* collisionShape;
-	btCollisionShape* colShape;
-	btRigidBody* rigidBody;
-	btScalar mass;
+	vec3_t mins;
+	vec3_t maxs;
+	vec3_t center; //bounding sphere around the vertices, model space.
+	float radius;
+	collision_t collision;
+	btStridingMeshInterface* collisionMesh; //COLLISION_MESH, points into vertex_data and index_data.
+	btCollisionShape* colShape; //shared by every entity of the mesh.
+	float mass; //0 for static meshes.
 	btVector3 inertia;
-	struct mesh_ent_t* next;
-	struct mesh_ent_t* prev;
-	struct mesh_ent_t* parent;
-} mesh_ent_t;
-extern mesh_ent_t* meshes;
+	ent_t root; //spawned when the asset was loaded.
+	UniformMatrix* mat; //model space transform shared by every instance.
+	VkBuffer uniform_buffer;
+	VkDescriptorSet dset;
+	uint32_t uniform_offset;
+	uint32_t first_instance; //range of visible instances in instances.model, rebuilt by CullEntities.
+	uint32_t instance_count;
+} mesh_t;
+extern mesh_t meshes[MAX_MESHES];
+extern uint32_t mesh_count;
+
+//One ray or sphere sweep of a CastRays batch.
+typedef struct ray_query_t
+{
+	vec3_t from;
+	vec3_t to;
+	float radius; //0 casts a ray, anything larger sweeps a sphere.
+} ray_query_t;
+
+typedef struct ray_hit_t
+{
+	ent_t ent; //ENT_NONE on a miss.
+	float fraction;
+	vec3_t point;
+	vec3_t normal;
+} ray_hit_t;
+
+//Live entities are packed in [0, count), slot i of every array is the same entity.
+typedef struct ent_store_t
+{
+	uint32_t count;
+	ent_t handle[MAX_ENTITIES];
+	uint16_t mesh[MAX_ENTITIES];
+	vec3_t origin[MAX_ENTITIES]; //synced from the rigid bodies after every physics step.
+	Matrix transform[MAX_ENTITIES]; //model matrix, rotation included. Only moved bodies are rewritten.
+	vec3_t mins[MAX_ENTITIES]; //world bounds.
+	vec3_t maxs[MAX_ENTITIES];
+	float sphere[4][MAX_ENTITIES]; //world bounding sphere x, y, z, radius, planar for the batch cull.
+	btRigidBody* body[MAX_ENTITIES];
+	btDbvtNode* leaf[MAX_ENTITIES]; //scene tree leaf, its data is the handle index.
+} ent_store_t;
+extern ent_store_t ents;
+
+//Per-instance model matrices, vertex binding 1 of the triangle pipelines. Visible instances of a mesh are contiguous.
+typedef struct instance_buffer_t
+{
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	Matrix* model; //MAX_ENTITIES + 1, the last one is INSTANCE_IDENTITY.
+} instance_buffer_t;
+extern instance_buffer_t instances;
+
+struct cvar_s;
 
 namespace entity
 {
@@ -103,11 +194,30 @@ void UpdateCamera();
 void InitCamera();
 void ViewMatrix(float matrix[16]);
 void InitMeshes();
-mesh_ent_t* GetMesh(char* name, mesh_ent_t** last);
-mesh_ent_t* InstanceMesh(char* name);
+mesh_t* GetMesh(const char* name);
+ent_t Spawn(mesh_t* mesh);
+void Despawn(ent_t ent);
+int Slot(ent_t ent);
+btRigidBody* Body(ent_t ent);
+ent_t InstanceMesh(char* name);
+ent_t Launch(mesh_t* mesh, const vec3_t pos, const vec3_t velocity);
 void MoveTo(char* name, vec3_t pos);
-void SetPosition(mesh_ent_t* copy, vec3_t pos);
+void SetPosition(ent_t ent, vec3_t pos);
+void SyncTransforms();
+void FrustumPlanes(const float m[16], float planes[6][4]);
+uint32_t QueryFrustum(const float planes[6][4], uint16_t* slots);
+void CastRays(const ray_query_t* queries, ray_hit_t* hits, uint32_t count);
+uint32_t CullEntities(float mvp[16]);
 void InitPhysics();
+void PhysicsThreads(struct cvar_s* var);
+void TuneBroadphase(struct cvar_s* var);
+void Snapshot(struct cvar_s* var);
+void Rollback(struct cvar_s* var);
+void PhysicsProfile(struct cvar_s* var);
+void PhysicsRecord(struct cvar_s* var);
+void PhysicsReplay(struct cvar_s* var);
+void PhysicsLod(struct cvar_s* var);
+void UpdateLod();
 void StepPhysics();
 void SetupWorldPlane(float size);
 btVector3 GetRayTo(int x, int y);
@@ -0,0 +1,215 @@
+#include "font.h"
+#include "textures.h"
+#include "zone.h"
+#include "flog.h"
+#include "atlas.h"
+
+#include <math.h>
+
+/*
+==============================================================================
+
+					GLYPH CACHE
+
+The baked microui bitmap glyphs in atlas.h are the font source. A glyph is
+turned into a signed distance field the first time it is drawn and packed on
+shelves into a FONT_ATLAS_WIDTH x FONT_ATLAS_HEIGHT texture, one cached glyph
+serves every font size. Glyphs are built on the UI thread, the touched rows are
+uploaded by the main thread in Flush() before the frame is submitted.
+==============================================================================
+*/
+
+#define FONT_GLYPH_TEXELS 64 //largest padded glyph side.
+
+static unsigned char* font_pixels = nullptr;
+static int font_texture = -1;
+static glyph_t glyph_cache[FONT_GLYPHS];
+static font_t fonts[FONT_MAX];
+static int font_count = 0;
+static int shelf_x = 0;
+static int shelf_y = 0;
+static int shelf_h = 0;
+static int dirty_min = FONT_ATLAS_HEIGHT; //rows written since the last Flush().
+static int dirty_max = 0;
+
+namespace font
+{
+
+static float Texel(mu_Rect src, int x, int y)
+{
+	if(x < 0 || y < 0 || x >= src.w || y >= src.h)
+	{
+		return 0.0f;
+	}
+	return atlas_texture[(src.y + y) * ATLAS_WIDTH + src.x + x] / 255.0f;
+}
+
+//bilinear coverage, u and v in source texels.
+static float Coverage(mu_Rect src, float u, float v)
+{
+	int x = (int) floorf(u);
+	int y = (int) floorf(v);
+	float fx = u - x;
+	float fy = v - y;
+	float top = Texel(src, x, y) * (1.0f - fx) + Texel(src, x + 1, y) * fx;
+	float bottom = Texel(src, x, y + 1) * (1.0f - fx) + Texel(src, x + 1, y + 1) * fx;
+	return top * (1.0f - fy) + bottom * fy;
+}
+
+static void BuildGlyph(const glyph_t* g, mu_Rect src)
+{
+	static bool inside[FONT_GLYPH_TEXELS * FONT_GLYPH_TEXELS];
+
+	for(int y = 0; y<g->h; y++)
+	{
+		for(int x = 0; x<g->w; x++)
+		{
+			float u = (x - FONT_SDF_SPREAD + 0.5f) / FONT_SDF_SCALE - 0.5f;
+			float v = (y - FONT_SDF_SPREAD + 0.5f) / FONT_SDF_SCALE - 0.5f;
+			inside[y * g->w + x] = Coverage(src, u, v) >= 0.5f;
+		}
+	}
+
+	//brute force, glyphs are tiny and every one is built once.
+	const int spread = FONT_SDF_SPREAD;
+	for(int y = 0; y<g->h; y++)
+	{
+		for(int x = 0; x<g->w; x++)
+		{
+			bool in = inside[y * g->w + x];
+			int best = spread * spread;
+			for(int j = q_max(y - spread, 0); j<=q_min(y + spread, g->h - 1); j++)
+			{
+				for(int i = q_max(x - spread, 0); i<=q_min(x + spread, g->w - 1); i++)
+				{
+					if(inside[j * g->w + i] != in)
+					{
+						best = q_min(best, (i - x) * (i - x) + (j - y) * (j - y));
+					}
+				}
+			}
+			//the edge lies halfway between two texel centers.
+			float d = sqrtf(float(best)) - 0.5f;
+			float value = 0.5f + (in ? d : -d) / (2.0f * spread);
+			value = q_max(q_min(value, 1.0f), 0.0f);
+			font_pixels[(g->y + y) * FONT_ATLAS_WIDTH + g->x + x] = (unsigned char)(value * 255.0f + 0.5f);
+		}
+	}
+}
+
+bool Init()
+{
+	font_pixels = (unsigned char*) zone::Hunk_AllocName(FONT_ATLAS_WIDTH * FONT_ATLAS_HEIGHT, "font_atlas");
+	//tex_descriptor_sets[0] is bound by draw::PresentUI, this must be the first texture.
+	font_texture = textures::UploadTexture(font_pixels, FONT_ATLAS_WIDTH, FONT_ATLAS_HEIGHT, VK_FORMAT_R8_UNORM, true);
+	Create("default", FONT_BASE_SIZE);
+	return true;
+}
+
+//Main thread, while the UI thread is parked.
+void Flush()
+{
+	if(dirty_min >= dirty_max)
+	{
+		return;
+	}
+	textures::UpdateTextureRegion(font_pixels + dirty_min * FONT_ATLAS_WIDTH, 0, dirty_min,
+	                              FONT_ATLAS_WIDTH, dirty_max - dirty_min, font_texture);
+	dirty_min = FONT_ATLAS_HEIGHT;
+	dirty_max = 0;
+}
+
+font_t* Create(const char* name, float size)
+{
+	if(font_count == FONT_MAX)
+	{
+		error("FONT_MAX reached, %s uses the default font.", name);
+		return Default();
+	}
+
+	font_t* font = &fonts[font_count++];
+	font->name = name;
+	font->size = size;
+	font->scale = size / FONT_BASE_SIZE;
+	for(int i = 0; i<FONT_GLYPHS; i++)
+	{
+		font->advance[i] = (i < 32) ? 0.0f : Source(i).w * font->scale;
+	}
+	//the baked font has no kerning pairs, the table is still consulted for every pair.
+	zone::Q_memset(font->kerning, 0, sizeof(font->kerning));
+	return font;
+}
+
+font_t* Default()
+{
+	return &fonts[0];
+}
+
+mu_Rect Source(int codepoint)
+{
+	return (codepoint < 32) ? atlas[codepoint - 1] : atlas[codepoint - 27];
+}
+
+//Returns the cached glyph, builds it on first use. Null when the atlas is full.
+const glyph_t* Glyph(int codepoint)
+{
+	glyph_t* g = &glyph_cache[codepoint];
+	if(g->cached)
+	{
+		return g;
+	}
+
+	mu_Rect src = Source(codepoint);
+	int w = src.w * FONT_SDF_SCALE + FONT_SDF_SPREAD * 2;
+	int h = src.h * FONT_SDF_SCALE + FONT_SDF_SPREAD * 2;
+	ASSERT(w <= FONT_GLYPH_TEXELS && h <= FONT_GLYPH_TEXELS, "Glyph larger than FONT_GLYPH_TEXELS");
+
+	if(shelf_x + w > FONT_ATLAS_WIDTH)
+	{
+		shelf_x = 0;
+		shelf_y += shelf_h;
+		shelf_h = 0;
+	}
+	if(shelf_y + h > FONT_ATLAS_HEIGHT)
+	{
+		warn("Font atlas is full, glyph %d is not drawn.", codepoint);
+		return nullptr;
+	}
+
+	g->x = shelf_x;
+	g->y = shelf_y;
+	g->w = w;
+	g->h = h;
+	shelf_x += w;
+	shelf_h = q_max(shelf_h, h);
+
+	BuildGlyph(g, src);
+	g->cached = true;
+	dirty_min = q_min(dirty_min, int(g->y));
+	dirty_max = q_max(dirty_max, int(g->y) + h);
+	return g;
+}
+
+float Kerning(const font_t* font, int left, int right)
+{
+	return font->kerning[left][right] * font->scale;
+}
+
+int TextWidth(const font_t* font, const char* text, int len)
+{
+	float res = 0;
+	int prev = 0;
+	for (const char* p = text; *p && len--; p++)
+	{
+		if ((*p & 0xc0) == 0x80)
+		{
+			continue;
+		}
+		int c = Codepoint(p);
+		res += font->advance[c] + Kerning(font, prev, c);
+		prev = c;
+	}
+	return int(res + 0.5f);
+}
+
+} //namespace font
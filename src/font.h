@@ -0,0 +1,53 @@
+#ifndef __FONT_H__
+#define __FONT_H__
+
+#include "startup.h"
+#include "microui.h"
+
+//-----------------------------------
+#define FONT_ATLAS_WIDTH 512
+#define FONT_ATLAS_HEIGHT 512
+#define FONT_SDF_SCALE 2 //atlas texels per source texel.
+#define FONT_SDF_SPREAD 4 //distance range in atlas texels, also the padding around a glyph.
+#define FONT_GLYPHS 128 //ascii, the ui icons take the codepoints below 32.
+#define FONT_MAX 8
+#define FONT_BASE_SIZE 18 //line height of the baked source glyphs.
+//-----------------------------------
+
+typedef struct
+{
+	uint16_t	x, y; //atlas rect, padding included.
+	uint16_t	w, h;
+	bool		cached;
+} glyph_t;
+
+typedef struct
+{
+	const char*	name;
+	float		size; //line height in pixels.
+	float		scale; //size / FONT_BASE_SIZE.
+	float		advance[FONT_GLYPHS]; //pixels at this size.
+	int8_t		kerning[FONT_GLYPHS][FONT_GLYPHS]; //source pixels, [left][right].
+} font_t;
+
+namespace font
+{
+
+bool Init();
+void Flush();
+font_t* Create(const char* name, float size);
+font_t* Default();
+const glyph_t* Glyph(int codepoint);
+mu_Rect Source(int codepoint);
+float Kerning(const font_t* font, int left, int right);
+int TextWidth(const font_t* font, const char* text, int len);
+
+//text never reaches the icons, MU_ICON_* are addressed as codepoints 1..4.
+static inline int Codepoint(const char* p)
+{
+	return mu_clamp((unsigned char) *p, 32, FONT_GLYPHS - 1);
+}
+
+} //namespace font
+
+#endif
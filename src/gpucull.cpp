@@ -0,0 +1,224 @@
+#include "gpucull.h"
+#include "control.h"
+#include "entity.h"
+#include "window.h"
+#include "cvar.h"
+#include "flog.h"
+#include "profiler.h"
+/* {
+GVAR: logical_device -> startup.cpp
+GVAR: pipelines -> render.cpp
+GVAR: pipeline_layout -> render.cpp
+GVAR: graphics_queue_family_index -> window.cpp
+GVAR: compute_queue_family_index -> window.cpp
+} */
+
+/*
+==============================================================================
+
+					GPU CULLING
+
+The entity bounds are uploaded once per frame and cull.comp.glsl tests them
+against the frustum on ComputeQueue. A visible entity takes the next slot in
+the range of its mesh, copies its model matrix there and so bumps the
+instanceCount of that mesh's indirect command. draw::Meshes records one
+vkCmdDrawIndexedIndirect per mesh, however many entities there are, and the
+graphics submit waits on ComputeSemaphore before the commands are read.
+==============================================================================
+*/
+
+//buffers, in the order of the cull.comp.glsl bindings.
+enum
+{
+	CULL_INPUT,
+	CULL_DRAWS,
+	CULL_INSTANCES,
+	CULL_BUFFERS
+};
+
+typedef struct
+{
+	float		planes[6][4];
+	uint32_t	count;
+} cull_push_t;
+
+VkBuffer cull_draw_buffer = VK_NULL_HANDLE;
+VkBuffer cull_instance_buffer = VK_NULL_HANDLE;
+uint32_t cull_pipeline = 0;
+
+static VkBuffer cull_buffers[CULL_BUFFERS];
+static unsigned char* cull_data[CULL_BUFFERS];
+static VkDeviceMemory cull_memory = VK_NULL_HANDLE;
+static VkDescriptorSet cull_descriptor_set = VK_NULL_HANDLE;
+
+namespace gpucull
+{
+
+bool Init()
+{
+	trace("Initializing gpu culling buffers");
+
+	const VkDeviceSize sizes[CULL_BUFFERS] =
+	{
+		MAX_ENTITIES * sizeof(cull_input_t),
+		MAX_MESHES * sizeof(VkDrawIndexedIndirectCommand),
+		MAX_ENTITIES * sizeof(Matrix)
+	};
+	const VkBufferUsageFlags usages[CULL_BUFFERS] =
+	{
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+	};
+	//written on the compute family, read on the graphics family.
+	uint32_t families[2] = {graphics_queue_family_index, compute_queue_family_index};
+
+	VkBufferCreateInfo buffer_create_info;
+	memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	if(families[0] != families[1])
+	{
+		buffer_create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		buffer_create_info.queueFamilyIndexCount = 2;
+		buffer_create_info.pQueueFamilyIndices = families;
+	}
+
+	VkDeviceSize offsets[CULL_BUFFERS];
+	VkDeviceSize total = 0;
+	uint32_t type_bits = ~0u;
+	for(int i = 0; i<CULL_BUFFERS; i++)
+	{
+		buffer_create_info.size = sizes[i];
+		buffer_create_info.usage = usages[i];
+		if(vkCreateBuffer(logical_device, &buffer_create_info, allocators, &cull_buffers[i]) != VK_SUCCESS)
+		{
+			fatal("Could not create gpu culling buffer %d.", i);
+			return false;
+		}
+
+		VkMemoryRequirements memory_requirements;
+		vkGetBufferMemoryRequirements(logical_device, cull_buffers[i], &memory_requirements);
+		total = (total + memory_requirements.alignment - 1) & ~(memory_requirements.alignment - 1);
+		offsets[i] = total;
+		total += memory_requirements.size;
+		type_bits &= memory_requirements.memoryTypeBits;
+	}
+
+	//the cpu rewrites the input and the commands every frame, nothing is flushed.
+	VkMemoryAllocateInfo memory_allocate_info;
+	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = total;
+	memory_allocate_info.memoryTypeIndex = control::MemoryTypeFromProperties(type_bits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0);
+	if(vkAllocateMemory(logical_device, &memory_allocate_info, allocators, &cull_memory) != VK_SUCCESS)
+	{
+		fatal("Could not allocate gpu culling memory.");
+		return false;
+	}
+
+	void* data;
+	VK_CHECK(vkMapMemory(logical_device, cull_memory, 0, total, 0, &data));
+	for(int i = 0; i<CULL_BUFFERS; i++)
+	{
+		VK_CHECK(vkBindBufferMemory(logical_device, cull_buffers[i], cull_memory, offsets[i]));
+		cull_data[i] = (unsigned char*) data + offsets[i];
+	}
+	//nothing is drawn until the first Dispatch.
+	memset(cull_data[CULL_DRAWS], 0, sizes[CULL_DRAWS]);
+	cull_draw_buffer = cull_buffers[CULL_DRAWS];
+	cull_instance_buffer = cull_buffers[CULL_INSTANCES];
+
+	VkDescriptorSetAllocateInfo descriptor_set_allocate_info;
+	descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptor_set_allocate_info.pNext = nullptr;
+	descriptor_set_allocate_info.descriptorPool = descriptor_pool;
+	descriptor_set_allocate_info.descriptorSetCount = 1;
+	descriptor_set_allocate_info.pSetLayouts = &sbo_dsl;
+	VK_CHECK(vkAllocateDescriptorSets(logical_device, &descriptor_set_allocate_info, &cull_descriptor_set));
+
+	VkDescriptorBufferInfo buffer_info[CULL_BUFFERS];
+	VkWriteDescriptorSet sbo_write[CULL_BUFFERS];
+	for(int i = 0; i<CULL_BUFFERS; i++)
+	{
+		buffer_info[i].buffer = cull_buffers[i];
+		buffer_info[i].offset = 0;
+		buffer_info[i].range = VK_WHOLE_SIZE;
+
+		sbo_write[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		sbo_write[i].pNext = nullptr;
+		sbo_write[i].dstSet = cull_descriptor_set;
+		sbo_write[i].dstBinding = i;
+		sbo_write[i].dstArrayElement = 0;
+		sbo_write[i].descriptorCount = 1;
+		sbo_write[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		sbo_write[i].pImageInfo = nullptr;
+		sbo_write[i].pBufferInfo = &buffer_info[i];
+		sbo_write[i].pTexelBufferView = nullptr;
+	}
+	vkUpdateDescriptorSets(logical_device, CULL_BUFFERS, sbo_write, 0, nullptr);
+	return true;
+}
+
+//Main thread, after the physics step and before the graphics submit.
+void Dispatch(float mvp[16])
+{
+	CPU_SCOPE("CullDispatch");
+	//waits for the previous dispatch, the last frame's draws are done with the buffers too.
+	control::BeginCompute();
+
+	cull_input_t* input = (cull_input_t*) cull_data[CULL_INPUT];
+	uint32_t count[MAX_MESHES] = {};
+	for(uint32_t i = 0; i<ents.count; i++)
+	{
+		for(int k = 0; k<4; k++)
+		{
+			input[i].sphere[k] = ents.sphere[k][i];
+		}
+		input[i].model = ents.transform[i];
+		input[i].mesh = ents.mesh[i];
+		count[ents.mesh[i]]++;
+	}
+
+	//every mesh gets room for all of its entities, the shader counts the visible ones.
+	VkDrawIndexedIndirectCommand* draws = (VkDrawIndexedIndirectCommand*) cull_data[CULL_DRAWS];
+	uint32_t first = 0;
+	for(uint32_t m = 0; m<mesh_count; m++)
+	{
+		draws[m].indexCount = meshes[m].index_count;
+		draws[m].instanceCount = 0;
+		draws[m].firstIndex = 0;
+		draws[m].vertexOffset = 0;
+		draws[m].firstInstance = first;
+		first += count[m];
+	}
+
+	cull_push_t push;
+	entity::FrustumPlanes(mvp, push.planes);
+	if(!cull.value)
+	{
+		//a plane every point is in front of.
+		for(int p = 0; p<6; p++)
+		{
+			push.planes[p][0] = push.planes[p][1] = push.planes[p][2] = 0.0f;
+			push.planes[p][3] = 1.0f;
+		}
+	}
+	push.count = ents.count;
+
+	vkCmdBindPipeline(compute_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[cull_pipeline]);
+	vkCmdBindDescriptorSets(compute_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout[2], 0, 1, &cull_descriptor_set, 0, nullptr);
+	vkCmdPushConstants(compute_command_buffer, pipeline_layout[2], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+	vkCmdDispatch(compute_command_buffer, (ents.count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	control::SubmitCompute();
+}
+
+void Destroy()
+{
+	for(int i = 0; i<CULL_BUFFERS; i++)
+	{
+		vkDestroyBuffer(logical_device, cull_buffers[i], allocators);
+	}
+	vkFreeMemory(logical_device, cull_memory, allocators);
+}
+
+} //namespace gpucull
@@ -0,0 +1,31 @@
+#ifndef __GPUCULL_H__
+#define __GPUCULL_H__
+
+#include "startup.h"
+#include "render.h"
+
+//-----------------------------------
+#define CULL_GROUP_SIZE 64 //local_size_x of cull.comp.glsl.
+//-----------------------------------
+
+//one entity as cull.comp.glsl reads it, std430.
+typedef struct
+{
+	float		sphere[4]; //world center and radius.
+	Matrix		model;
+	uint32_t	mesh;
+	uint32_t	pad[3]; //std430 rounds the struct up to 16 bytes.
+} cull_input_t;
+
+extern VkBuffer cull_draw_buffer; //VkDrawIndexedIndirectCommand per mesh.
+extern VkBuffer cull_instance_buffer; //visible model matrices, grouped per mesh.
+extern uint32_t cull_pipeline; //pipelines[] index, set by shaders::LoadShaders.
+
+namespace gpucull
+{
+bool Init();
+void Dispatch(float mvp[16]);
+void Destroy();
+} //namespace gpucull
+
+#endif
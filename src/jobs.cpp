@@ -0,0 +1,164 @@
+#include "jobs.h"
+#include "profiler.h"
+#include "flog.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/*
+==============================================================================
+
+					JOB POOL
+
+A fixed set of worker threads that split an index range with the thread that
+dispatched it. Chunks of grain indices are taken from a shared counter until
+the range is used up, the dispatcher returns once every worker has left the
+range. One range runs at a time, a ParallelFor issued from inside a job or
+while another thread owns the pool runs inline on the caller. A range may use
+fewer workers than the pool has, the physics world is limited that way
+without shrinking the pool for everyone else.
+Workers are started on demand and parked when SetThreads lowers the count, so
+every thread keeps its profiler ring for the life of the process.
+==============================================================================
+*/
+
+typedef struct
+{
+	job_func_t			func;
+	void*				data;
+	int					end;
+	int					grain;
+	std::atomic<int>	next;
+} job_t;
+
+static std::thread job_threads[JOBS_MAX_THREADS];
+static int job_started = 0; //threads created so far.
+static int job_workers = 0; //threads that take part in a range.
+static job_t job;
+static uint32_t job_generation = 0; //bumped for every dispatched range.
+static int job_limit = 0; //workers that take part in the current range.
+static int job_pending = 0; //workers that have not left the current range.
+static bool job_quit = false;
+static std::mutex job_mutex;
+static std::mutex dispatch_mutex;
+static std::condition_variable job_cv;
+static std::condition_variable done_cv;
+static thread_local bool job_inside = false;
+
+namespace jobs
+{
+
+static void RunChunks()
+{
+	for(;;)
+	{
+		int begin = job.next.fetch_add(job.grain);
+		if(begin >= job.end)
+		{
+			return;
+		}
+		job.func(job.data, begin, q_min(begin + job.grain, job.end));
+	}
+}
+
+static void Worker(int n, uint32_t seen)
+{
+	profiler::CpuThreadName("job");
+	job_inside = true;
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lk(job_mutex);
+			job_cv.wait(lk, [&]{ return job_quit || job_generation != seen; });
+			if(job_quit)
+			{
+				return;
+			}
+			seen = job_generation;
+			if(n >= job_limit)
+			{
+				continue;
+			}
+		}
+		RunChunks();
+		std::lock_guard<std::mutex> lk(job_mutex);
+		if(--job_pending == 0)
+		{
+			done_cv.notify_one();
+		}
+	}
+}
+
+void SetThreads(int count)
+{
+	count = q_max(q_min(count, JOBS_MAX_THREADS), 0);
+	std::lock_guard<std::mutex> dispatch(dispatch_mutex);
+	std::lock_guard<std::mutex> lk(job_mutex);
+	for(; job_started < count; job_started++)
+	{
+		job_threads[job_started] = std::thread(Worker, job_started, job_generation);
+	}
+	job_workers = count;
+	trace("Job pool runs %d workers.", count);
+}
+
+int Threads()
+{
+	return job_workers;
+}
+
+//func is called with [begin, end) sub ranges of at most grain indices, workers caps the pool threads that help.
+void ParallelFor(int begin, int end, int grain, job_func_t func, void* data, int workers)
+{
+	if(end <= begin)
+	{
+		return;
+	}
+	grain = q_max(grain, 1);
+	if(job_inside || workers <= 0 || !job_workers || end - begin <= grain || !dispatch_mutex.try_lock())
+	{
+		func(data, begin, end);
+		return;
+	}
+
+	job.func = func;
+	job.data = data;
+	job.end = end;
+	job.grain = grain;
+	job.next = begin;
+	{
+		std::lock_guard<std::mutex> lk(job_mutex);
+		job_limit = q_min(workers, job_workers);
+		job_pending = job_limit;
+		job_generation++;
+	}
+	job_cv.notify_all();
+
+	job_inside = true;
+	RunChunks();
+	job_inside = false;
+	{
+		std::unique_lock<std::mutex> lk(job_mutex);
+		done_cv.wait(lk, []{ return job_pending == 0; });
+	}
+	dispatch_mutex.unlock();
+}
+
+void Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lk(job_mutex);
+		job_quit = true;
+	}
+	job_cv.notify_all();
+	for(int i = 0; i<job_started; i++)
+	{
+		job_threads[i].join();
+	}
+	job_started = 0;
+	job_workers = 0;
+}
+
+} //namespace jobs
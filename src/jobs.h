@@ -0,0 +1,20 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include "startup.h"
+
+//-----------------------------------
+#define JOBS_MAX_THREADS 8 //workers, the dispatching thread runs chunks too.
+//-----------------------------------
+
+typedef void (*job_func_t)(void* data, int begin, int end);
+
+namespace jobs
+{
+void SetThreads(int count);
+int Threads();
+void ParallelFor(int begin, int end, int grain, job_func_t func, void* data, int workers = JOBS_MAX_THREADS);
+void Shutdown();
+} //namespace jobs
+
+#endif
@@ -0,0 +1,602 @@
+#include "profiler.h"
+#include "control.h"
+#include "cvar.h"
+#include "zone.h"
+#include "flog.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+/* {
+GVAR: logical_device -> startup.cpp
+GVAR: queryPool -> startup.cpp
+GVAR: device_properties -> startup.cpp
+GVAR: command_buffer -> control.cpp
+} */
+
+/*
+==============================================================================
+
+					GPU PROFILER
+
+Every frame in flight owns GPU_MAX_SCOPES query pairs. Scope 0 is the whole
+frame, written by the primary command buffer. Other scopes can be opened from
+any recording thread with GPU_SCOPE("name"), they nest per thread.
+A range is read back only when its slot comes around again, by then its fence
+has signaled so vkGetQueryPoolResults never has to wait.
+==============================================================================
+*/
+
+typedef struct
+{
+	const char*	name;
+	int			depth;
+} gpu_scope_t;
+
+static gpu_scope_t gpu_scopes[GPU_PROFILER_FRAMES][GPU_MAX_SCOPES];
+static std::atomic<int> gpu_scope_count[GPU_PROFILER_FRAMES];
+static int gpu_slot = 0;
+static bool gpu_frame_open = false;
+static thread_local int gpu_depth = 0;
+
+static gpu_timing_t gpu_timings[GPU_MAX_SCOPES];
+static int gpu_timing_count = 0;
+
+static FILE* gpu_trace = nullptr;
+static int gpu_trace_frames = 0;
+static bool gpu_trace_first = true;
+
+typedef struct
+{
+	const char*				thread;
+	std::atomic<uint32_t>	head;
+	cpu_event_t				events[CPU_RING_SIZE];
+} cpu_ring_t;
+
+static cpu_ring_t cpu_rings[CPU_MAX_THREADS];
+static std::atomic<int> cpu_ring_count;
+static thread_local cpu_ring_t* cpu_ring = nullptr;
+static thread_local bool cpu_ring_full = false; //this thread came after CPU_MAX_THREADS, its events are dropped.
+static uint64_t cpu_capture_begin = 0;
+static int cpu_capture_frames = 0;
+
+typedef struct
+{
+	const char*	name;
+	uint64_t	begin;
+	int			zone; //row in physics_frame, -1 off the stepping thread.
+} physics_open_t;
+
+static thread_local physics_open_t physics_stack[PHYSICS_ZONE_DEPTH];
+static thread_local int physics_depth = 0;
+static thread_local bool physics_stepping = false;
+static uint64_t physics_step_begin = 0;
+static physics_frame_t physics_frame; //built by the stepping thread.
+static physics_frame_t physics_shown; //last published step, read by the panel.
+static std::mutex physics_mutex;
+static FILE* physics_trace = nullptr;
+static int physics_trace_frames = 0;
+static int physics_trace_step = 0;
+
+namespace profiler
+{
+
+static inline uint32_t GpuQuery(int slot, int scope)
+{
+	return (slot * GPU_MAX_SCOPES + scope) * 2;
+}
+
+static void GpuTraceWrite(int slot, uint64_t* results, int count)
+{
+	double us = device_properties.limits.timestampPeriod * 1e-3;
+	for(int i = 0; i<count; i++)
+	{
+		fprintf(gpu_trace, "%s{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+		        gpu_trace_first ? "" : ",\n", gpu_scopes[slot][i].name, gpu_scopes[slot][i].depth,
+		        double(results[i*2]) * us, double(results[i*2+1] - results[i*2]) * us);
+		gpu_trace_first = false;
+	}
+
+	if(--gpu_trace_frames == 0)
+	{
+		fprintf(gpu_trace, "\n]}\n");
+		fclose(gpu_trace);
+		gpu_trace = nullptr;
+		info("GPU trace written to ./gpu_trace.json");
+		Cvar_SetQuick(&gpu_trace_capture, "0");
+	}
+}
+
+static void GpuResolve(int slot)
+{
+	int count = q_min(gpu_scope_count[slot].load(), GPU_MAX_SCOPES);
+	if(count == 0)
+		return;
+
+	uint64_t results[GPU_MAX_SCOPES * 2];
+	VkResult result = vkGetQueryPoolResults(logical_device, queryPool, GpuQuery(slot, 0), count * 2,
+	                                        sizeof(results), results, sizeof(results[0]), VK_QUERY_RESULT_64_BIT);
+	if(result != VK_SUCCESS)
+	{
+		//VK_NOT_READY, drop this sample rather than stall.
+		return;
+	}
+
+	double period = device_properties.limits.timestampPeriod * 1e-6;
+	gpu_timing_t timings[GPU_MAX_SCOPES];
+	for(int i = 0; i<count; i++)
+	{
+		gpu_timing_t* t = &timings[i];
+		t->name = gpu_scopes[slot][i].name;
+		t->depth = gpu_scopes[slot][i].depth;
+		t->begin = double(results[i*2] - results[0]) * period;
+		t->ms = double(results[i*2+1] - results[i*2]) * period;
+		t->avg = t->ms;
+		for(int j = 0; j<gpu_timing_count; j++)
+		{
+			if(gpu_timings[j].depth == t->depth && !zone::Q_strcmp(gpu_timings[j].name, t->name))
+			{
+				t->avg = gpu_timings[j].avg * 0.95 + t->ms * 0.05;
+				break;
+			}
+		}
+	}
+
+	//scopes from different threads are allocated in any order, sort them by gpu time.
+	for(int i = 1; i<count; i++)
+	{
+		gpu_timing_t t = timings[i];
+		int j = i - 1;
+		while(j > 0 && timings[j].begin > t.begin)
+		{
+			timings[j+1] = timings[j];
+			j--;
+		}
+		timings[j+1] = t;
+	}
+
+	zone::Q_memcpy(gpu_timings, timings, sizeof(gpu_timing_t) * count);
+	gpu_timing_count = count;
+
+	if(gpu_trace)
+	{
+		GpuTraceWrite(slot, results, count);
+	}
+}
+
+void GpuBeginFrame(VkCommandBuffer cb)
+{
+	if(queryPool == VK_NULL_HANDLE)
+		return;
+
+	GpuResolve(gpu_slot);
+
+	vkCmdResetQueryPool(cb, queryPool, GpuQuery(gpu_slot, 0), GPU_MAX_SCOPES * 2);
+	gpu_scopes[gpu_slot][0].name = "frame";
+	gpu_scopes[gpu_slot][0].depth = 0;
+	gpu_scope_count[gpu_slot] = 1;
+	vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, GpuQuery(gpu_slot, 0));
+	gpu_frame_open = true;
+}
+
+void GpuEndFrame(VkCommandBuffer cb)
+{
+	if(!gpu_frame_open)
+		return;
+
+	vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, GpuQuery(gpu_slot, 0) + 1);
+	gpu_frame_open = false;
+	gpu_slot = (gpu_slot + 1) % GPU_PROFILER_FRAMES;
+}
+
+int GpuBeginScope(const char* name)
+{
+	if(!gpu_frame_open)
+		return -1;
+
+	int scope = gpu_scope_count[gpu_slot]++;
+	if(scope >= GPU_MAX_SCOPES)
+	{
+		warn("GPU_MAX_SCOPES reached, %s is not profiled.", name);
+		return -1;
+	}
+	gpu_scopes[gpu_slot][scope].name = name;
+	gpu_scopes[gpu_slot][scope].depth = ++gpu_depth;
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, GpuQuery(gpu_slot, scope));
+	return scope;
+}
+
+void GpuEndScope(int scope)
+{
+	if(scope < 0)
+		return;
+
+	gpu_depth--;
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, GpuQuery(gpu_slot, scope) + 1);
+}
+
+double GpuFrameMs()
+{
+	return gpu_timing_count ? gpu_timings[0].ms : 0.0;
+}
+
+void GpuPanel(mu_Context* ctx)
+{
+	static mu_Container window;
+	static gpu_timing_t shown[GPU_MAX_SCOPES];
+	static int shown_count = 0;
+	static uint64_t shown_at = 0;
+
+	//refreshed twice a second, readable and lets the cached ui stay idle in between.
+	uint64_t now = CpuNow();
+	if(now - shown_at > 500000000ull)
+	{
+		zone::Q_memcpy(shown, gpu_timings, sizeof(gpu_timing_t) * gpu_timing_count);
+		shown_count = gpu_timing_count;
+		shown_at = now;
+	}
+
+	if (!window.inited)
+	{
+		mu_init_window(ctx, &window, 0);
+		window.rect = mu_rect(660, 40, 260, 200);
+	}
+
+	if (mu_begin_window(ctx, &window, "GPU Profiler"))
+	{
+		int widths[] = { 150, -1 };
+		mu_layout_row(ctx, 2, widths, 0);
+		char buf[64];
+		for(int i = 0; i<shown_count; i++)
+		{
+			int indent = q_min(shown[i].depth * 2, 16);
+			snprintf(buf, sizeof(buf), "%*s%s", indent, "", shown[i].name);
+			mu_label(ctx, buf);
+			snprintf(buf, sizeof(buf), "%.3f ms", shown[i].avg);
+			mu_label(ctx, buf);
+		}
+		mu_end_window(ctx);
+	}
+}
+
+//cvar callback, "gpu_trace_capture N" records the next N frames.
+void GpuTraceCapture(struct cvar_s* var)
+{
+	if(var->value <= 0 || gpu_trace)
+		return;
+
+	gpu_trace = fopen("./gpu_trace.json", "w");
+	if(!gpu_trace)
+	{
+		error("Could not open ./gpu_trace.json");
+		return;
+	}
+	fprintf(gpu_trace, "{\"traceEvents\":[\n");
+	gpu_trace_first = true;
+	gpu_trace_frames = int(var->value);
+	info("Capturing %d frames of GPU timings.", gpu_trace_frames);
+}
+
+/*
+==============================================================================
+
+					CPU PROFILER
+
+Each thread writes complete begin/end events into its own ring, no locks and
+no allocations on the hot path. Old events are simply overwritten.
+"cpu_trace_capture N" dumps the events of the next N frames as Chrome trace
+JSON, rings are only read at the end of a frame when the workers are parked.
+==============================================================================
+*/
+
+//Null once CPU_MAX_THREADS rings are taken, a ring is never shared between two writers.
+static cpu_ring_t* CpuRing()
+{
+	if(!cpu_ring && !cpu_ring_full)
+	{
+		int index = cpu_ring_count++;
+		if(index >= CPU_MAX_THREADS)
+		{
+			error("CPU_MAX_THREADS reached, the events of this thread are dropped.");
+			cpu_ring_full = true;
+			return nullptr;
+		}
+		cpu_ring = &cpu_rings[index];
+		cpu_ring->thread = "thread";
+	}
+	return cpu_ring;
+}
+
+uint64_t CpuNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CpuThreadName(const char* name)
+{
+	cpu_ring_t* ring = CpuRing();
+	if(ring)
+	{
+		ring->thread = name;
+	}
+}
+
+void CpuPush(const char* name, uint64_t begin)
+{
+	cpu_ring_t* ring = CpuRing();
+	if(!ring)
+	{
+		return;
+	}
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	cpu_event_t* e = &ring->events[head % CPU_RING_SIZE];
+	e->name = name;
+	e->begin = begin;
+	e->end = CpuNow();
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+static void CpuTraceWrite()
+{
+	FILE* f = fopen("./cpu_trace.json", "w");
+	if(!f)
+	{
+		error("Could not open ./cpu_trace.json");
+		return;
+	}
+
+	bool first = true;
+	int threads = q_min(cpu_ring_count.load(), CPU_MAX_THREADS);
+	fprintf(f, "{\"traceEvents\":[\n");
+	for(int t = 0; t<threads; t++)
+	{
+		cpu_ring_t* ring = &cpu_rings[t];
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		        first ? "" : ",\n", t, ring->thread);
+		first = false;
+
+		uint32_t head = ring->head.load(std::memory_order_acquire);
+		uint32_t count = q_min(head, (uint32_t)CPU_RING_SIZE);
+		for(uint32_t i = head - count; i != head; i++)
+		{
+			cpu_event_t* e = &ring->events[i % CPU_RING_SIZE];
+			if(e->begin < cpu_capture_begin)
+				continue;
+			fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			        e->name, t, double(e->begin - cpu_capture_begin) * 1e-3, double(e->end - e->begin) * 1e-3);
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	info("CPU trace written to ./cpu_trace.json");
+}
+
+//Main thread, after Draw() returned.
+void CpuEndFrame()
+{
+	if(cpu_capture_frames == 0)
+		return;
+
+	if(--cpu_capture_frames == 0)
+	{
+		CpuTraceWrite();
+		Cvar_SetQuick(&cpu_trace_capture, "0");
+	}
+}
+
+//cvar callback, "cpu_trace_capture N" records the next N frames.
+void CpuTraceCapture(struct cvar_s* var)
+{
+	if(var->value <= 0 || cpu_capture_frames)
+		return;
+
+	cpu_capture_frames = int(var->value);
+	cpu_capture_begin = CpuNow();
+	info("Capturing %d frames of CPU events.", cpu_capture_frames);
+}
+
+/*
+==============================================================================
+
+					PHYSICS PROFILER
+
+Bullet times its stages with BT_PROFILE, PhysicsEnter and PhysicsLeave are
+installed as its zone hooks while physics_profile is set. Every zone goes into
+the CPU ring of its thread, so cpu_trace_capture shows the solver threads too.
+Zones of the thread inside PhysicsBeginStep/PhysicsEndStep are also summed per
+name into a table that the panel shows next to the world counters.
+"physics_trace_capture N" writes the next N steps to ./physics_trace.csv.
+==============================================================================
+*/
+
+void PhysicsEnter(const char* name)
+{
+	int depth = physics_depth++;
+	if(depth >= PHYSICS_ZONE_DEPTH)
+	{
+		return;
+	}
+	physics_open_t* open = &physics_stack[depth];
+	open->name = name;
+	open->begin = CpuNow();
+	open->zone = -1;
+	if(!physics_stepping)
+	{
+		return;
+	}
+
+	//a zone entered again in the same step, once per island for example, adds up in one row.
+	for(int i = 0; i<physics_frame.zone_count; i++)
+	{
+		if(physics_frame.zones[i].name == name && physics_frame.zones[i].depth == depth)
+		{
+			open->zone = i;
+			return;
+		}
+	}
+	if(physics_frame.zone_count < PHYSICS_MAX_ZONES)
+	{
+		open->zone = physics_frame.zone_count++;
+		gpu_timing_t* t = &physics_frame.zones[open->zone];
+		t->name = name;
+		t->depth = depth;
+		t->begin = 0.0;
+		t->ms = 0.0;
+		t->avg = 0.0;
+	}
+}
+
+void PhysicsLeave()
+{
+	if(physics_depth == 0)
+	{
+		return; //the hooks were installed inside a zone.
+	}
+	int depth = --physics_depth;
+	if(depth >= PHYSICS_ZONE_DEPTH)
+	{
+		return;
+	}
+	physics_open_t* open = &physics_stack[depth];
+	CpuPush(open->name, open->begin);
+	if(open->zone >= 0)
+	{
+		physics_frame.zones[open->zone].ms += double(CpuNow() - open->begin) * 1e-6;
+	}
+}
+
+void PhysicsBeginStep()
+{
+	physics_stepping = true;
+	physics_frame.zone_count = 0;
+	physics_step_begin = CpuNow();
+}
+
+//The caller fills in the world counters, then calls PhysicsPublish.
+physics_frame_t* PhysicsEndStep()
+{
+	physics_stepping = false;
+	physics_frame.step_ms = double(CpuNow() - physics_step_begin) * 1e-6;
+	return &physics_frame;
+}
+
+static void PhysicsTraceWrite(const physics_frame_t* f)
+{
+	fprintf(physics_trace, "%d,%.3f,%s,%.3f,%d,%d,%d,%d,%d,%d,%d,", physics_trace_step++, f->step_ms, f->broadphase,
+	        f->broadphase_ms, f->bodies, f->awake, f->parked, f->islands, f->pairs, f->manifolds, f->contacts);
+	for(int i = 0; i<f->zone_count; i++)
+	{
+		fprintf(physics_trace, "%s%s:%.3f", i ? ";" : "", f->zones[i].name, f->zones[i].ms);
+	}
+	fprintf(physics_trace, "\n");
+
+	if(--physics_trace_frames == 0)
+	{
+		fclose(physics_trace);
+		physics_trace = nullptr;
+		info("Physics trace written to ./physics_trace.csv");
+		Cvar_SetQuick(&physics_trace_capture, "0");
+	}
+}
+
+void PhysicsPublish()
+{
+	for(int i = 0; i<physics_frame.zone_count; i++)
+	{
+		gpu_timing_t* t = &physics_frame.zones[i];
+		t->avg = t->ms;
+		for(int j = 0; j<physics_shown.zone_count; j++)
+		{
+			if(physics_shown.zones[j].name == t->name && physics_shown.zones[j].depth == t->depth)
+			{
+				t->avg = physics_shown.zones[j].avg * 0.95 + t->ms * 0.05;
+				break;
+			}
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(physics_mutex);
+		physics_shown = physics_frame;
+	}
+	if(physics_trace)
+	{
+		PhysicsTraceWrite(&physics_frame);
+	}
+}
+
+void PhysicsPanel(mu_Context* ctx)
+{
+	static mu_Container window;
+	static physics_frame_t shown;
+	static uint64_t shown_at = 0;
+
+	//refreshed twice a second like the GPU panel.
+	uint64_t now = CpuNow();
+	if(now - shown_at > 500000000ull)
+	{
+		std::lock_guard<std::mutex> lock(physics_mutex);
+		shown = physics_shown;
+		shown_at = now;
+	}
+
+	if (!window.inited)
+	{
+		mu_init_window(ctx, &window, 0);
+		window.rect = mu_rect(660, 250, 260, 300);
+	}
+
+	if (mu_begin_window(ctx, &window, "Physics Profiler"))
+	{
+		int widths[] = { 150, -1 };
+		mu_layout_row(ctx, 2, widths, 0);
+		char buf[64];
+		const struct { const char* name; int value; } counters[] =
+		{
+			{"bodies", shown.bodies}, {"awake", shown.awake}, {"parked", shown.parked},
+			{"islands", shown.islands},
+			{"pairs", shown.pairs}, {"manifolds", shown.manifolds}, {"contacts", shown.contacts},
+		};
+		for(size_t i = 0; i<ARRAYSIZE(counters); i++)
+		{
+			mu_label(ctx, counters[i].name);
+			snprintf(buf, sizeof(buf), "%d", counters[i].value);
+			mu_label(ctx, buf);
+		}
+		mu_label(ctx, "step");
+		snprintf(buf, sizeof(buf), "%.3f ms", shown.step_ms);
+		mu_label(ctx, buf);
+		mu_label(ctx, shown.broadphase ? shown.broadphase : "broadphase");
+		snprintf(buf, sizeof(buf), "%.3f ms", shown.broadphase_ms);
+		mu_label(ctx, buf);
+		for(int i = 0; i<shown.zone_count; i++)
+		{
+			int indent = q_min(shown.zones[i].depth * 2, 16);
+			snprintf(buf, sizeof(buf), "%*s%s", indent, "", shown.zones[i].name);
+			mu_label(ctx, buf);
+			snprintf(buf, sizeof(buf), "%.3f ms", shown.zones[i].avg);
+			mu_label(ctx, buf);
+		}
+		mu_end_window(ctx);
+	}
+}
+
+//cvar callback, "physics_trace_capture N" records the next N physics steps.
+void PhysicsTraceCapture(struct cvar_s* var)
+{
+	if(var->value <= 0 || physics_trace)
+		return;
+
+	physics_trace = fopen("./physics_trace.csv", "w");
+	if(!physics_trace)
+	{
+		error("Could not open ./physics_trace.csv");
+		return;
+	}
+	fprintf(physics_trace, "step,step_ms,broadphase,broadphase_ms,bodies,awake,parked,islands,pairs,manifolds,contacts,zones\n");
+	physics_trace_frames = int(var->value);
+	physics_trace_step = 0;
+	info("Capturing %d physics steps.", physics_trace_frames);
+}
+
+} //namespace profiler
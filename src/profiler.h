@@ -0,0 +1,113 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "startup.h"
+#include "microui.h"
+
+//-----------------------------------
+#define GPU_PROFILER_FRAMES 2 //frames that can be in flight before a query range is reused.
+#define GPU_MAX_SCOPES 32
+#define GPU_PROFILER_QUERIES (GPU_PROFILER_FRAMES * GPU_MAX_SCOPES * 2)
+#define CPU_RING_SIZE 4096 //events kept per thread.
+#define CPU_MAX_THREADS 16 //main, ui, 3d and the job pool.
+#define PHYSICS_MAX_ZONES 32 //Bullet zones kept per step.
+#define PHYSICS_ZONE_DEPTH 16
+//-----------------------------------
+
+typedef struct
+{
+	const char*	name;
+	int			depth;
+	double		begin; //ms, relative to the frame begin.
+	double		ms;
+	double		avg;
+} gpu_timing_t;
+
+typedef struct
+{
+	const char*	name;
+	uint64_t	begin; //ns, steady clock.
+	uint64_t	end;
+} cpu_event_t;
+
+//Bullet's BT_PROFILE zones and world counters of one physics step.
+typedef struct
+{
+	gpu_timing_t	zones[PHYSICS_MAX_ZONES]; //begin is unused.
+	int				zone_count;
+	double			step_ms;
+	int				bodies;
+	int				awake;
+	int				islands;
+	const char*		broadphase;
+	double			broadphase_ms; //updateAabbs and calculateOverlappingPairs.
+	int				parked; //bodies the physics LOD took out of the world.
+	int				pairs; //broadphase overlaps.
+	int				manifolds; //narrowphase pairs that touch.
+	int				contacts;
+} physics_frame_t;
+
+struct cvar_s;
+
+namespace profiler
+{
+
+void GpuBeginFrame(VkCommandBuffer cb);
+void GpuEndFrame(VkCommandBuffer cb);
+int GpuBeginScope(const char* name);
+void GpuEndScope(int scope);
+double GpuFrameMs();
+void GpuPanel(mu_Context* ctx);
+void GpuTraceCapture(struct cvar_s* var);
+
+uint64_t CpuNow();
+void CpuThreadName(const char* name);
+void CpuPush(const char* name, uint64_t begin);
+void CpuEndFrame();
+void CpuTraceCapture(struct cvar_s* var);
+
+void PhysicsEnter(const char* name);
+void PhysicsLeave();
+void PhysicsBeginStep();
+physics_frame_t* PhysicsEndStep();
+void PhysicsPublish();
+void PhysicsPanel(mu_Context* ctx);
+void PhysicsTraceCapture(struct cvar_s* var);
+
+//Writes a timestamp pair around its lifetime into the thread's command_buffer.
+struct GpuScope
+{
+	int scope;
+	GpuScope(const char* name) : scope(GpuBeginScope(name)) {}
+	~GpuScope()
+	{
+		GpuEndScope(scope);
+	}
+};
+
+//Records a begin/end event into the calling thread's ring.
+struct CpuScope
+{
+	const char* name;
+	uint64_t begin;
+	CpuScope(const char* name) : name(name), begin(CpuNow()) {}
+	~CpuScope()
+	{
+		CpuPush(name, begin);
+	}
+};
+
+} //namespace profiler
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+
+#define CPU_SCOPE(name) profiler::CpuScope PROFILER_CONCAT(cpu_scope_, __LINE__)(name)
+
+#ifdef DEBUG
+#define GPU_SCOPE(name) profiler::GpuScope PROFILER_CONCAT(gpu_scope_, __LINE__)(name)
+#else
+#define GPU_SCOPE(name)
+#endif
+
+#endif
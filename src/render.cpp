@@ -24,6 +24,7 @@ uint32_t renderPassCount = 0;
 uint32_t framebufferCount = 0;
 uint32_t imageViewCount = 0;
 uint32_t pipelineCount = 0;
+uint32_t pipelineGeneration = 0;
 VkPipelineLayout pipeline_layout[20] = {};
 VkPipeline current_pipeline = 0;
 //}
@@ -166,8 +167,10 @@ void CreateDepthBuffer()
 	VkResult err;
 	if(depth_buffer)
 	{
-		DestroyDepthBuffer();
-		vkDestroyImageView(logical_device, imageViews[number_of_swapchain_images], nullptr);
+		//old depth buffer may still be used by a frame in flight.
+		control::RetireImageView(imageViews[number_of_swapchain_images]);
+		control::RetireImage(depth_buffer);
+		control::RetireMemory(depth_buffer_memory);
 	}
 
 	//todo: check if this is supported before attempting.
@@ -325,6 +328,16 @@ void CreatePipelineLayout()
 	createInfo.pushConstantRangeCount = 0;
 	createInfo.pPushConstantRanges = nullptr;
 	VK_CHECK(vkCreatePipelineLayout(logical_device, &createInfo, allocators, &pipeline_layout[1]));
+
+	//compute culling, frustum planes and the entity count.
+	ASSERT(sbo_dsl, "Descriptor set layout must be initialized before pipeline layout!");
+	push_constant_range.size = 25 * sizeof(float);
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	createInfo.setLayoutCount = 1;
+	createInfo.pSetLayouts = &sbo_dsl;
+	createInfo.pushConstantRangeCount = 1;
+	createInfo.pPushConstantRanges = &push_constant_range;
+	VK_CHECK(vkCreatePipelineLayout(logical_device, &createInfo, allocators, &pipeline_layout[2]));
 }
 
 void Viewport(float x, float y, float width, float height, float min_depth, float max_depth)
@@ -344,12 +357,15 @@ VkPipelineVertexInputStateCreateInfo* BasicTrianglePipe()
 {
 	zone::stack_alloc(100000);
 
-	VkVertexInputBindingDescription* bindingDescription = new(stack_mem) VkVertexInputBindingDescription[0];
+	VkVertexInputBindingDescription* bindingDescription = new(stack_mem) VkVertexInputBindingDescription[2];
 	bindingDescription[0].binding = 0;
 	bindingDescription[0].stride = sizeof(Vertex_);
 	bindingDescription[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	bindingDescription[1].binding = 1; //per-instance model matrix.
+	bindingDescription[1].stride = sizeof(Matrix);
+	bindingDescription[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
-	VkVertexInputAttributeDescription* attributeDescriptions = new(bindingDescription+sizeof(bindingDescription)) VkVertexInputAttributeDescription[3];
+	VkVertexInputAttributeDescription* attributeDescriptions = new(bindingDescription+sizeof(bindingDescription)) VkVertexInputAttributeDescription[7];
 	attributeDescriptions[0].binding = 0;
 	attributeDescriptions[0].location = 0;
 	attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
@@ -362,13 +378,20 @@ VkPipelineVertexInputStateCreateInfo* BasicTrianglePipe()
 	attributeDescriptions[2].location = 2;
 	attributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
 	attributeDescriptions[2].offset = offsetof(Vertex_, color);
+	for(uint32_t i = 0; i<4; i++) //a mat4 takes one location per column.
+	{
+		attributeDescriptions[3 + i].binding = 1;
+		attributeDescriptions[3 + i].location = 3 + i;
+		attributeDescriptions[3 + i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescriptions[3 + i].offset = i * 4 * sizeof(float);
+	}
 
 	VkPipelineVertexInputStateCreateInfo* vertexInput = new(&attributeDescriptions[0] + sizeof(attributeDescriptions)) VkPipelineVertexInputStateCreateInfo[0];
 	vertexInput[0].sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	vertexInput[0].pNext = nullptr;
 	vertexInput[0].flags = 0;
-	vertexInput[0].vertexBindingDescriptionCount = 1;
-	vertexInput[0].vertexAttributeDescriptionCount = 3;
+	vertexInput[0].vertexBindingDescriptionCount = 2;
+	vertexInput[0].vertexAttributeDescriptionCount = 7;
 	vertexInput[0].pVertexBindingDescriptions = bindingDescription;
 	vertexInput[0].pVertexAttributeDescriptions = &attributeDescriptions[0];
 
@@ -757,6 +780,28 @@ void CreateTessGraphicsPipeline
 
 }
 
+void CreateComputePipeline(VkPipelineCache pipelineCache, int layout_index, VkShaderModule cs)
+{
+	ASSERT(cs, "Failed to load Compute Shader.");
+
+	VkComputePipelineCreateInfo createInfo;
+	createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	createInfo.pNext = nullptr;
+	createInfo.flags = 0;
+	createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	createInfo.stage.pNext = nullptr;
+	createInfo.stage.flags = 0;
+	createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	createInfo.stage.module = cs;
+	createInfo.stage.pName = "main";
+	createInfo.stage.pSpecializationInfo = nullptr;
+	createInfo.layout = pipeline_layout[layout_index];
+	createInfo.basePipelineHandle = 0;
+	createInfo.basePipelineIndex = 0;
+
+	VK_CHECK(vkCreateComputePipelines(logical_device, pipelineCache, 1, &createInfo, 0, &pipelines[pipelineCount++]));
+}
+
 void RebuildPipelines(struct cvar_s* s)
 {
 	p("Rebuilding pipeleines.");
@@ -18,6 +18,7 @@ extern uint32_t renderPassCount;
 extern uint32_t framebufferCount;
 extern uint32_t imageViewCount;
 extern uint32_t pipelineCount;
+extern uint32_t pipelineGeneration; //bumped whenever the pipelines are recreated.
 
 extern VkPipelineLayout pipeline_layout[20];
 extern VkPipeline current_pipeline;
@@ -85,6 +86,7 @@ void CreateGraphicsPipeline(VkPipelineCache pipelineCache, VkPipelineVertexInput
 void CreateTessGraphicsPipeline
 (VkPipelineCache pipelineCache, VkPipelineVertexInputStateCreateInfo* (*vertexInput)(),
  int render_index, VkShaderModule vs, VkShaderModule fs, VkShaderModule cs, VkShaderModule es);
+void CreateComputePipeline(VkPipelineCache pipelineCache, int layout_index, VkShaderModule cs);
 void CreatePipelineLayout();
 void DestroyDepthBuffer();
 void CreateDepthBuffer();
@@ -4,8 +4,11 @@
 #include "zone.h"
 #include "render.h"
 #include "flog.h"
+#include "profiler.h"
+#include "gpucull.h"
 /* {
 GVAR: logical_device -> startup.cpp
+GVAR: cull_pipeline -> gpucull.cpp
 GVAR: VkShaderModule _shaders[20] -> /standalone/standalone.cpp
 GVAR: uint32_t cur_shader_index -> /standalone/standalone.cpp
 } */
@@ -26,7 +29,8 @@ static char* sfilenames[][1] =
 	{"./res/shaders/shader.tesc.glsl"},
 	{"./res/shaders/shader.tese.glsl"},
 	{"./res/shaders/skydome.frag.glsl"},
-	{"./res/shaders/skydome.vert.glsl"}
+	{"./res/shaders/skydome.vert.glsl"},
+	{"./res/shaders/cull.comp.glsl"}
 };
 
 static char* shaders[][5] =
@@ -40,7 +44,8 @@ static char* shaders[][5] =
 	{"6", sfilenames[6][0], "-V", "-o", "./res/shaders/shader.tesc.spv"},
 	{"7", sfilenames[7][0], "-V", "-o", "./res/shaders/shader.tese.spv"},
 	{"8", sfilenames[8][0], "-V", "-o", "./res/shaders/skydome.tese.spv"},
-	{"9", sfilenames[9][0], "-V", "-o", "./res/shaders/skydome.tese.spv"}
+	{"9", sfilenames[9][0], "-V", "-o", "./res/shaders/skydome.tese.spv"},
+	{"10", sfilenames[10][0], "-V", "-o", "./res/shaders/cull.comp.spv"}
 };
 
 class UpdateListener : public FW::FileWatchListener
@@ -49,6 +54,7 @@ public:
 	UpdateListener() {}
 	void handleFileAction(FW::WatchID watchid, const FW::String& dir, const FW::String& filename, FW::Action action)
 	{
+		CPU_SCOPE("ShaderReload");
 		info("Reloading shader file: %s %s, action: %d", &dir[0], &filename[0], action);
 
 		// Reload everything because doing this with single shoot does not work
@@ -83,6 +89,7 @@ FW::FileWatcher* fileWatcher;
 //this must be called only when logical device is initialized already.
 void CompileShaders()
 {
+	CPU_SCOPE("CompileShaders");
 	fileWatcher = new FW::FileWatcher(); //calls Z_Malloc()
 	for(uint8_t i = 0; i<ARRAYSIZE(shaders); ++i)
 	{
@@ -119,12 +126,16 @@ void LoadShaders()
 	VkShaderModule shaderTES = shaders::loadShaderMem(7);
 	VkShaderModule SkyDomeFS = shaders::loadShaderMem(8);
 	VkShaderModule SkyDomeVS = shaders::loadShaderMem(9);
+	VkShaderModule cullCS = shaders::loadShaderMem(10);
 
 	render::CreateGraphicsPipeline(pipelineCache, render::BasicTrianglePipe, 0, VK_POLYGON_MODE_FILL, triangleVS, triangleFS);
 	render::CreateGraphicsPipeline(pipelineCache, render::ScreenPipe, 0, VK_POLYGON_MODE_FILL, screenVS, screenFS);
 	render::CreateTessGraphicsPipeline(pipelineCache, render::Vec4FloatPipe, 0, shaderVS, shaderFS, shaderTCS, shaderTES);
 	render::CreateGraphicsPipeline(pipelineCache, render::Vec3FloatPipe, 0, VK_POLYGON_MODE_FILL, SkyDomeVS, SkyDomeFS);
 	render::CreateGraphicsPipeline(pipelineCache, render::BasicTrianglePipe, 0, VK_POLYGON_MODE_LINE, triangleVS, triangleFS);
+	cull_pipeline = pipelineCount;
+	render::CreateComputePipeline(pipelineCache, 2, cullCS);
+	pipelineGeneration++;
 
 }
 
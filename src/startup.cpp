@@ -454,7 +454,9 @@ bool CheckPhysicalDeviceExtensions()
 	return true;
 }
 
-bool CheckQueueProperties(VkQueueFlags desired_capabilities,  uint32_t &queue_family_index )
+//avoided_capabilities prefers a dedicated family, ie a compute queue without graphics
+//runs asynchronously on most hardware. Falls back to any family with the desired bits.
+bool CheckQueueProperties(VkQueueFlags desired_capabilities,  uint32_t &queue_family_index, VkQueueFlags avoided_capabilities)
 {
 	vkGetPhysicalDeviceQueueFamilyProperties(target_device, &queue_families_count, nullptr);
 	if(queue_families_count == 0)
@@ -470,6 +472,15 @@ bool CheckQueueProperties(VkQueueFlags desired_capabilities,  uint32_t &queue_fa
 		return false;
 	}
 	for(uint32_t i = 0; i<queue_families_count; ++i)
+	{
+		if(queue_families[i].queueCount > 0 && (queue_families[i].queueFlags & desired_capabilities) == desired_capabilities &&
+		        (queue_families[i].queueFlags & avoided_capabilities) == 0)
+		{
+			queue_family_index = i;
+			return true;
+		}
+	}
+	for(uint32_t i = 0; avoided_capabilities && i<queue_families_count; ++i)
 	{
 		if(queue_families[i].queueCount > 0 && (queue_families[i].queueFlags & desired_capabilities) == desired_capabilities)
 		{
@@ -102,7 +102,7 @@ bool LoadDeviceLevelFunctions();
 bool CheckInstanceExtensions();
 bool CheckPhysicalDeviceExtensions();
 bool CheckPhysicalDevices();
-bool CheckQueueProperties(VkQueueFlags desired_capabilities,  uint32_t &queue_family_index);
+bool CheckQueueProperties(VkQueueFlags desired_capabilities,  uint32_t &queue_family_index, VkQueueFlags avoided_capabilities = 0);
 bool IsExtensionSupported(const char* extension);
 bool CreateVulkanInstance(uint32_t count, const char** exts);
 bool CreateLogicalDevice(QueueInfo *array, int number_of_queues, uint32_t ext_count, const char** exts);
@@ -1,4 +1,5 @@
 #include "swapchain.h"
+#include "control.h"
 #include "zone.h"
 #include "flog.h"
 /* {
@@ -199,7 +200,8 @@ bool CreateSwapchain(VkSwapchainKHR &_swapchain, VkSwapchainKHR &old_swapchain)
 
 	if( VK_NULL_HANDLE != old_swapchain )
 	{
-		vkDestroySwapchainKHR( logical_device, old_swapchain, nullptr );
+		//presentation of the old images may still be pending.
+		control::RetireSwapchain( old_swapchain );
 		old_swapchain = VK_NULL_HANDLE;
 	}
 
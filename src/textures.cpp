@@ -4,6 +4,7 @@
 #include "zone.h"
 #include "lodepng.h"
 #include "flog.h"
+#include "profiler.h"
 #include <math.h>
 
 /* {
@@ -23,6 +24,7 @@ static int current_tex_ds_index = 0;
 static unsigned char palette[768];
 static unsigned int data[256];
 static VkSampler point_sampler = VK_NULL_HANDLE;
+static VkSampler linear_sampler = VK_NULL_HANDLE; //clamped, distance field glyphs.
 
 namespace textures
 {
@@ -73,6 +75,16 @@ void InitSamplers()
 		if (err != VK_SUCCESS)
 			fatal("vkCreateSampler failed");
 
+		sampler_create_info.magFilter = VK_FILTER_LINEAR;
+		sampler_create_info.minFilter = VK_FILTER_LINEAR;
+		sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+		err = vkCreateSampler(logical_device, &sampler_create_info, nullptr, &linear_sampler);
+		if (err != VK_SUCCESS)
+			fatal("vkCreateSampler failed");
+
 
 		/* 		sampler_create_info.anisotropyEnable = VK_TRUE;
 				sampler_create_info.maxAnisotropy = logical_device_properties.limits.maxSamplerAnisotropy;
@@ -104,6 +116,7 @@ void InitSamplers()
 void TexDeinit()
 {
 	vkDestroySampler(logical_device, point_sampler, nullptr);
+	vkDestroySampler(logical_device, linear_sampler, nullptr);
 	for(int i = 0; i<current_tex_ds_index; i++)
 	{
 		vkDestroyImage(logical_device, v_image[i], nullptr);
@@ -112,13 +125,13 @@ void TexDeinit()
 
 }
 
-void SetFilterModes(int tex_index, VkImageView *imgView)
+void SetFilterModes(int tex_index, VkImageView *imgView, VkSampler sampler)
 {
 	VkDescriptorImageInfo image_info;
 	memset(&image_info, 0, sizeof(image_info));
 	image_info.imageView = *imgView;
 	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	image_info.sampler = point_sampler;
+	image_info.sampler = sampler;
 
 	VkWriteDescriptorSet texture_write;
 	memset(&texture_write, 0, sizeof(texture_write));
@@ -208,7 +221,57 @@ void UpdateTexture(unsigned char* image, int w, int h, int index)
 	control::SubmitStagingBuffer();
 }
 
-void UploadTexture(unsigned char* image, int w, int h, VkFormat format)
+//Keeps the image in SHADER_READ_ONLY_OPTIMAL, only the given rows and columns are replaced. 8-bit textures only.
+void UpdateTextureRegion(unsigned char* image, int x, int y, int w, int h, int index)
+{
+	unsigned char* staging_memory = control::StagingBufferDigress(w*h, 4);
+	zone::Q_memcpy(staging_memory, image, w*h);
+
+	VkBufferImageCopy regions = {};
+	regions.bufferOffset = staging_buffers[current_staging_buffer].current_offset;
+	regions.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	regions.imageSubresource.layerCount = 1;
+	regions.imageSubresource.mipLevel = 0;
+	regions.imageOffset = {x, y, 0};
+	regions.imageExtent.width = w;
+	regions.imageExtent.height = h;
+	regions.imageExtent.depth = 1;
+
+	control::SetCommandBuffer(current_staging_buffer);
+
+	VkImageMemoryBarrier image_memory_barrier;
+	memset(&image_memory_barrier, 0, sizeof(image_memory_barrier));
+	image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_memory_barrier.image = v_image[index];
+	image_memory_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	image_memory_barrier.subresourceRange.baseMipLevel = 0;
+	image_memory_barrier.subresourceRange.levelCount = 1;
+	image_memory_barrier.subresourceRange.baseArrayLayer = 0;
+	image_memory_barrier.subresourceRange.layerCount = 1;
+
+	//the rest of the image is still sampled, so its old layout has to be kept.
+	image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	image_memory_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	image_memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+
+	vkCmdCopyBufferToImage(command_buffer, staging_buffers[current_staging_buffer].buffer, v_image[index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &regions);
+
+	image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+
+	control::SetCommandBuffer(0);
+	control::SubmitStagingBuffer();
+}
+
+//Returns the index of the texture in tex_descriptor_sets.
+int UploadTexture(unsigned char* image, int w, int h, VkFormat format, bool linear)
 {
 	VkDescriptorSetAllocateInfo dsai;
 	memset(&dsai, 0, sizeof(dsai));
@@ -260,12 +323,13 @@ try_again:
 
 	VK_CHECK(vkCreateImageView(logical_device, &createInfo, 0, &imageViews[imageViewCount++]));
 
-	SetFilterModes(current_tex_ds_index, &imageViews[imageViewCount-1]);
+	SetFilterModes(current_tex_ds_index, &imageViews[imageViewCount-1], linear ? linear_sampler : point_sampler);
 
 	//	p("%d", current_staging_buffer);
 
-	unsigned char* staging_memory = control::StagingBufferDigress((w*h*4), 4);
-	zone::Q_memcpy(staging_memory, image, (w * h * 4));
+	int texel_size = (format == VK_FORMAT_R8_UNORM) ? 1 : 4;
+	unsigned char* staging_memory = control::StagingBufferDigress((w*h*texel_size), 4);
+	zone::Q_memcpy(staging_memory, image, (w * h * texel_size));
 
 	VkBufferImageCopy regions = {};
 	regions.bufferOffset = staging_buffers[current_staging_buffer].current_offset;
@@ -307,13 +371,13 @@ try_again:
 
 	control::SetCommandBuffer(0);
 	control::SubmitStagingBuffer();
-	current_tex_ds_index++;
-
+	return current_tex_ds_index++;
 }
 
 
 void FsLoadPngTexture(const char* filename)
 {
+	CPU_SCOPE("FsLoadPngTexture");
 	ASSERT(filename, "Null pointer passed into FsLoadPngTexture");
 	// Load file and decode image.
 	unsigned char mem[sizeof(std::vector<unsigned char>)];
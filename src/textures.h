@@ -6,12 +6,13 @@ extern VkDescriptorSet	tex_descriptor_sets[20];
 namespace textures
 {
 unsigned char* Tex8to32(unsigned char* image, int l);
-void UploadTexture(unsigned char* image, int w, int h, VkFormat format);
+int UploadTexture(unsigned char* image, int w, int h, VkFormat format, bool linear = false);
 bool SampleTexture();
 void GenerateColorPalette();
 void FsLoadPngTexture(const char* filename);
 void InitSamplers();
 void TexDeinit();
 void UpdateTexture(unsigned char* image, int w, int h, int index);
+void UpdateTextureRegion(unsigned char* image, int x, int y, int w, int h, int index);
 bool SampleTextureUpdate();
 }
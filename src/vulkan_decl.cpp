@@ -123,6 +123,7 @@ PFN_vkCmdSetScissor vkCmdSetScissor;
 PFN_vkCmdBindVertexBuffers vkCmdBindVertexBuffers;
 PFN_vkCmdDraw vkCmdDraw;
 PFN_vkCmdDrawIndexed vkCmdDrawIndexed;
+PFN_vkCmdDrawIndexedIndirect vkCmdDrawIndexedIndirect;
 PFN_vkCmdDispatch vkCmdDispatch;
 PFN_vkCmdCopyImage vkCmdCopyImage;
 PFN_vkCmdPushConstants vkCmdPushConstants;
@@ -124,6 +124,7 @@ extern PFN_vkCmdSetScissor vkCmdSetScissor;
 extern PFN_vkCmdBindVertexBuffers vkCmdBindVertexBuffers;
 extern PFN_vkCmdDraw vkCmdDraw;
 extern PFN_vkCmdDrawIndexed vkCmdDrawIndexed;
+extern PFN_vkCmdDrawIndexedIndirect vkCmdDrawIndexedIndirect;
 extern PFN_vkCmdDispatch vkCmdDispatch;
 extern PFN_vkCmdCopyImage vkCmdCopyImage;
 extern PFN_vkCmdPushConstants vkCmdPushConstants;
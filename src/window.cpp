@@ -6,9 +6,14 @@
 #include "flog.h"
 #include "entity.h"
 #include "cvar.h"
+#include "profiler.h"
+#include "font.h"
+#include "gpucull.h"
+#include "jobs.h"
 
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 
 /* {
 GVAR: framebufferCount -> render.cpp
@@ -33,10 +38,12 @@ VkSemaphore ReadySemaphore;
 VkFence Fence_one;
 VkQueue GraphicsQueue;
 VkQueue ComputeQueue;
+VkQueue TransferQueue;
 int window_width = 1280;
 int window_height = 960;
 uint32_t graphics_queue_family_index; // <- this is queue 1
 uint32_t compute_queue_family_index; // <- this is queue 2
+uint32_t transfer_queue_family_index; // <- this is queue 3
 double time1 = 0;
 double y_wheel = 0;
 double xm_norm = 0;
@@ -60,27 +67,44 @@ static VkImageMemoryBarrier image_memory_barrier_before_present = {};
 static VkSubmitInfo submit_info = {};
 static VkPresentInfoKHR present_info = {};
 static uint32_t image_index;
-static VkPipelineStageFlags flags = {VK_PIPELINE_STAGE_ALL_COMMANDS_BIT};
+static VkSemaphore wait_semaphores[2];
+static VkPipelineStageFlags flags[2] = {VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
 static std::mutex mtx[2]; //locking
 static std::condition_variable cvx[2]; //signaling
 static bool run_threads[2] = {};
 static bool quit = false;
+static bool minimized = false;
 static double frameCpuAvg = 0;
 static double frameGpuAvg = 0;
+static bool ui_input = false; //DrainInput applied events this frame.
+static bool ui_valid = false; //scommand_buffers[1] can be replayed as is.
+static bool cull_recorded = false; //Main3DThread recorded indirect draws this frame.
+static uint32_t ui_hash = 0;
 
 namespace window
 {
 
 void window_size_callback(GLFWwindow* _window, int width, int height)
 {
-	//handle minimization.
-	while (width == 0 || height == 0)
+	//handle minimization, mainLoop sleeps until we get a real size back.
+	if (width == 0 || height == 0)
 	{
-		glfwGetFramebufferSize(_window, &width, &height);
-		glfwWaitEvents();
+		minimized = true;
+		return;
 	}
+	minimized = false;
 
-	VK_CHECK(vkDeviceWaitIdle(logical_device));
+	//no device drain here, whatever the last frames still use is retired
+	//and freed by control::CollectRetired once their fences have signaled.
+	for(uint32_t i = 0; i<number_of_swapchain_images; i++)
+	{
+		control::RetireImageView(imageViews[i]);
+	}
+	for(uint32_t i = 0; i<framebufferCount; i++)
+	{
+		control::RetireFramebuffer(framebuffers[i]);
+	}
+	framebufferCount = 0;
 
 	old_swapchain = _swapchain;
 	_swapchain = VK_NULL_HANDLE;
@@ -98,17 +122,10 @@ void window_size_callback(GLFWwindow* _window, int width, int height)
 	window_height = height;
 	window_width = width;
 
-	for(uint32_t i = 0; i<number_of_swapchain_images; i++)
-	{
-		vkDestroyImageView(logical_device, imageViews[i], nullptr);
-	}
 	uint32_t tmpc = imageViewCount;
 	imageViewCount = 0;
 	render::CreateSwapchainImageViews();
 
-	render::DestroyFramebuffers();
-	framebufferCount = 0;
-
 	render::CreateDepthBuffer();
 	imageViewCount = tmpc;
 
@@ -118,7 +135,7 @@ void window_size_callback(GLFWwindow* _window, int width, int height)
 	}
 }
 
-void keyCallback(GLFWwindow* _window, int key, int scancode, int action, int mods)
+static void OnKey(int key, int action)
 {
 	if (action == GLFW_PRESS)
 	{
@@ -155,10 +172,9 @@ void keyCallback(GLFWwindow* _window, int key, int scancode, int action, int mod
 				}
 				break;
 			case GLFW_KEY_E:
-				mesh_ent_t* target = entity::InstanceMesh("./res/kitty.obj");
 				vec3_t pos = {cam.pos[0], cam.pos[1], cam.pos[2]};
-				entity::SetPosition(target, pos);
-				target->rigidBody->setLinearVelocity(btVector3(cam.front[0]*5, cam.front[1]*5, cam.front[2]*5));
+				vec3_t velocity = {cam.front[0]*5, cam.front[1]*5, cam.front[2]*5};
+				entity::Launch(entity::GetMesh("./res/kitty.obj"), pos, velocity);
 				//spawn and shoot the model at index 0 for fun, test things ...
 				break;
 
@@ -201,7 +217,7 @@ void processInput()
 btVector3 rayFrom;
 btVector3 rayTo;
 
-void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
+static void OnCursor(double xpos, double ypos)
 {
 	static float lastX = window_height / 2.0f;
 	static float lastY = window_width / 2.0f;
@@ -247,7 +263,7 @@ void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
 	//entity::MovePickedBody(rayFrom, rayTo);
 }
 
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+static void OnScroll(double xoffset, double yoffset)
 {
 	y_wheel += yoffset;
 	if (cam.zoom >= 1.0f && cam.zoom <= 45.0f)
@@ -260,7 +276,7 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 	mu_input_scroll(ctx, 0, (int)yoffset * -30);
 }
 
-void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+static void OnMouseButton(int button, int action)
 {
 	switch(action)
 	{
@@ -272,10 +288,6 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 		else
 		{
 			mu_input_mousedown(ctx, xm, ym, 1);
-			mesh_ent_t* m = entity::GetMesh("./res/kitty.obj", nullptr);
-			btTransform transform;
-			m->rigidBody->getMotionState()->getWorldTransform(transform);
-			btVector3 origin = transform.getOrigin();
 
 			float invview[16];
 			float invproj[16];
@@ -380,13 +392,120 @@ fo[3] = 1;
 	}
 }
 
-void character_callback(GLFWwindow* window, unsigned int codepoint)
+static void OnChar(unsigned int codepoint)
 {
-	char k[1];
+	char k[2];
 	k[0] = codepoint;
+	k[1] = '\0';
 	mu_input_text(ctx, k);
 }
 
+/*
+==============================================================================
+
+					INPUT QUEUE
+
+GLFW callbacks only record events here. They are applied in one place,
+DrainInput() at the start of a frame before any worker is awake, so cam,
+ctx and the picking state are never touched while the workers read them.
+Single producer (GLFW callbacks), single consumer (Draw), no locks.
+==============================================================================
+*/
+
+enum
+{
+	INPUT_KEY,
+	INPUT_CURSOR,
+	INPUT_SCROLL,
+	INPUT_BUTTON,
+	INPUT_CHAR
+};
+
+typedef struct
+{
+	uint8_t		type;
+	int			a;
+	int			b;
+	double		x;
+	double		y;
+} input_event_t;
+
+static input_event_t input_queue[INPUT_QUEUE_SIZE];
+static std::atomic<uint32_t> input_head; //written by the producer only.
+static std::atomic<uint32_t> input_tail; //written by the consumer only.
+
+static void PushInput(uint8_t type, int a, int b, double x, double y)
+{
+	uint32_t head = input_head.load(std::memory_order_relaxed);
+	if(head - input_tail.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE)
+	{
+		warn("Input queue is full, event dropped.");
+		return;
+	}
+	input_event_t* e = &input_queue[head & (INPUT_QUEUE_SIZE - 1)];
+	e->type = type;
+	e->a = a;
+	e->b = b;
+	e->x = x;
+	e->y = y;
+	input_head.store(head + 1, std::memory_order_release);
+}
+
+void DrainInput()
+{
+	uint32_t tail = input_tail.load(std::memory_order_relaxed);
+	uint32_t head = input_head.load(std::memory_order_acquire);
+	ui_input = tail != head;
+	for(; tail != head; tail++)
+	{
+		input_event_t* e = &input_queue[tail & (INPUT_QUEUE_SIZE - 1)];
+		switch(e->type)
+		{
+		case INPUT_KEY:
+			OnKey(e->a, e->b);
+			break;
+		case INPUT_CURSOR:
+			OnCursor(e->x, e->y);
+			break;
+		case INPUT_SCROLL:
+			OnScroll(e->x, e->y);
+			break;
+		case INPUT_BUTTON:
+			OnMouseButton(e->a, e->b);
+			break;
+		case INPUT_CHAR:
+			OnChar((unsigned int)e->a);
+			break;
+		}
+	}
+	input_tail.store(tail, std::memory_order_release);
+}
+
+void keyCallback(GLFWwindow* _window, int key, int scancode, int action, int mods)
+{
+	PushInput(INPUT_KEY, key, action, 0, 0);
+}
+
+void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
+{
+	PushInput(INPUT_CURSOR, 0, 0, xpos, ypos);
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	PushInput(INPUT_SCROLL, 0, 0, xoffset, yoffset);
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+	PushInput(INPUT_BUTTON, button, action, 0, 0);
+}
+
+void character_callback(GLFWwindow* window, unsigned int codepoint)
+{
+	PushInput(INPUT_CHAR, (int)codepoint, 0, 0, 0);
+}
+
 void initWindow()
 {
 	glfwInit();
@@ -403,28 +522,83 @@ void initWindow()
 	glfwSetCharCallback(_window, character_callback);
 }
 
-static  char logbuf[64000];
+static char log_lines[CONSOLE_LINES][CONSOLE_LINE_LENGTH];
+static uint32_t log_head = 0; //lines written so far, log_head % CONSOLE_LINES is the next slot.
 static   int logbuf_updated = 0;
 static char input_buf[128];
 static int submitted = 0;
 
+//Every line takes the next ring slot, so an append never depends on the history length.
+static void print_log(const char *text)
+{
+	while(*text)
+	{
+		char* line = log_lines[log_head % CONSOLE_LINES];
+		int len = 0;
+		while(*text && *text != '\n' && len < CONSOLE_LINE_LENGTH - 1)
+		{
+			line[len++] = *text++;
+		}
+		line[len] = '\0';
+		if(*text == '\n')
+		{
+			text++;
+		}
+		log_head++;
+	}
+	logbuf_updated = 1;
+}
+
 static void write_log(char *text)
 {
 	if(text[0])
 	{
 		int len = zone::Q_sstrlen(text);
 		text[len] = '\0';
-		logbuf_updated = 1;
 		if(!Cvar_Set(text, &text[len+1]))
 		{
 			len = zone::Q_strlen(text);
 			char s[] = ": command not found.\n";
 			zone::Q_memcpy(text+len, s, ARRAYSIZE(s));
-			zone::Q_strcat(logbuf, text);
+			print_log(text);
 			return;
 		}
-		zone::Q_strcat(logbuf, text);
-		zone::Q_strcat(logbuf, "\n");
+		print_log(text);
+	}
+}
+
+/*
+Only the lines inside the panel are laid out and drawn, the lines above and
+below are reserved as empty rows so the scrollbar still covers the history.
+Lines are clipped to the panel instead of wrapped.
+*/
+static void log_panel(mu_Context *ctx, mu_Container *panel)
+{
+	int width[] = {-1};
+	int line_height = ctx->text_height(ctx->style->font);
+	int pitch = line_height + ctx->style->spacing;
+	int count = q_min(log_head, (uint32_t)CONSOLE_LINES);
+	uint32_t oldest = log_head - count;
+	int first = q_min(panel->scroll.y / pitch, count);
+	int visible = q_min(panel->body.h / pitch + 2, count - first);
+	int below = count - first - visible;
+
+	if (first > 0)
+	{
+		mu_layout_row(ctx, 1, width, first * pitch - ctx->style->spacing);
+		mu_layout_next(ctx);
+	}
+	mu_layout_row(ctx, 1, width, line_height);
+	for (int i = 0; i<visible; i++)
+	{
+		mu_Rect r = mu_layout_next(ctx);
+		const char* line = log_lines[(oldest + first + i) % CONSOLE_LINES];
+		mu_draw_text(ctx, ctx->style->font, line, -1, mu_vec2(r.x, r.y), ctx->style->colors[MU_COLOR_TEXT]);
+	}
+	if (below > 0)
+	{
+		mu_layout_row(ctx, 1, width, below * pitch - ctx->style->spacing);
+		mu_layout_next(ctx);
 	}
 }
 
@@ -456,8 +630,7 @@ static void console(mu_Context *ctx)
 		int width[] = {-1};
 		mu_layout_row(ctx, 1, width, -28);
 		mu_begin_panel(ctx, &panel);
-		mu_layout_row(ctx, 1, width, -1);
-		mu_text(ctx, logbuf);
+		log_panel(ctx, &panel);
 		mu_end_panel(ctx);
 		if (logbuf_updated)
 		{
@@ -542,8 +715,76 @@ static void style_window(mu_Context *ctx)
 	}
 }
 
+//Everything that ends up in the recorded ui, microui commands included.
+static uint32_t UIHash()
+{
+	uint32_t hash = zone::Q_hash(ctx->command_list.items, ctx->command_list.idx);
+	hash = zone::Q_hash(&window_width, sizeof(window_width), hash);
+	hash = zone::Q_hash(&window_height, sizeof(window_height), hash);
+	hash = zone::Q_hash(&lastfps, sizeof(lastfps), hash);
+	//a buffer recorded with ui_cache 0 holds timestamp writes into queries that are not reset again.
+	hash = zone::Q_hash(&ui_cache.value, sizeof(ui_cache.value), hash);
+	return zone::Q_hash(&pipelineGeneration, sizeof(pipelineGeneration), hash);
+}
+
+//Turns the microui command list into quads and records scommand_buffers[1].
+static void RecordUI()
+{
+	mu_Command* cmd = nullptr;
+	draw::BeginUI();
+	while (mu_next_command(ctx, &cmd))
+	{
+		switch (cmd->type)
+		{
+		case MU_COMMAND_TEXT:
+			draw::Text(cmd->text.str, cmd->text.pos, cmd->text.color, cmd->text.font);
+			break;
+		case MU_COMMAND_RECT:
+			draw::Rect(cmd->rect.rect, cmd->rect.color);
+			break;
+		case MU_COMMAND_ICON:
+			draw::Icon(cmd->icon.id, cmd->icon.rect, cmd->icon.color);
+			break;
+		}
+	}
+
+	if(mfocus)
+	{
+		draw::Cursor();
+	}
+	draw::Stats();
+
+	VkCommandBufferInheritanceInfo cbii;
+	cbii.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	cbii.pNext = nullptr;
+	cbii.renderPass = renderPasses[0];
+	cbii.subpass = 0;
+	cbii.framebuffer = VK_NULL_HANDLE; //unknown, the buffer may be replayed into any swapchain image.
+	cbii.occlusionQueryEnable = VK_FALSE;
+	cbii.queryFlags = 0;
+	cbii.pipelineStatistics = 0;
+
+	command_buffer = scommand_buffers[1];
+	control::BeginCommandBufferRecordingOperation(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, &cbii);
+
+	VkViewport viewport = {0, 0, float(window_width), float(window_height), 0, 1 };
+	VkRect2D scissor = { {0, 0}, {uint32_t(window_width), uint32_t(window_height)} };
+
+	vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+	vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+	vkCmdPushConstants(command_buffer, pipeline_layout[0], VK_SHADER_STAGE_VERTEX_BIT,
+	                   16 * sizeof(float), sizeof(uint32_t), &window_width);
+	vkCmdPushConstants(command_buffer, pipeline_layout[0], VK_SHADER_STAGE_VERTEX_BIT,
+	                   16 * sizeof(float) + sizeof(uint32_t), sizeof(uint32_t), &window_height);
+
+	draw::PresentUI();
+
+	VK_CHECK(vkEndCommandBuffer(command_buffer));
+}
+
 void UIThread()
 {
+	profiler::CpuThreadName("ui");
 	for(;;)
 	{
 		// Wait until Draw() signals
@@ -554,61 +795,29 @@ void UIThread()
 		{
 			return;
 		}
-		mu_Command* cmd = nullptr;
+		uint64_t cpu_begin = profiler::CpuNow();
 		mu_begin(ctx);
 		console(ctx);
 		style_window(ctx);
-		mu_end(ctx);
-
-		//record ui commands.
-		while (mu_next_command(ctx, &cmd))
+#ifdef DEBUG
+		profiler::GpuPanel(ctx);
+#endif
+		if(physics_profile.value)
 		{
-			switch (cmd->type)
-			{
-			case MU_COMMAND_TEXT:
-				draw::Text(cmd->text.str, cmd->text.pos, cmd->text.color);
-				break;
-			case MU_COMMAND_RECT:
-				draw::Rect(cmd->rect.rect, cmd->rect.color);
-				break;
-			case MU_COMMAND_ICON:
-				draw::Icon(cmd->icon.id, cmd->icon.rect, cmd->icon.color);
-				break;
-			}
+			profiler::PhysicsPanel(ctx);
 		}
+		mu_end(ctx);
 
-		if(mfocus)
+		//the blinking cursor changes every frame, never cache while it is shown.
+		uint32_t hash = UIHash();
+		if(!ui_cache.value || !ui_valid || ui_input || mfocus || hash != ui_hash)
 		{
-			draw::Cursor();
+			RecordUI();
+			ui_hash = hash;
+			ui_valid = true;
 		}
-		draw::Stats();
-
-		VkCommandBufferInheritanceInfo cbii;
-		cbii.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
-		cbii.pNext = nullptr;
-		cbii.renderPass = renderPasses[0];
-		cbii.subpass = 0;
-		cbii.framebuffer = framebuffers[image_index];
-		cbii.occlusionQueryEnable = VK_FALSE;
-		cbii.queryFlags = 0;
-		cbii.pipelineStatistics = 0;
-
-		command_buffer = scommand_buffers[1];
-		control::BeginCommandBufferRecordingOperation(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, &cbii);
 
-		VkViewport viewport = {0, 0, float(window_width), float(window_height), 0, 1 };
-		VkRect2D scissor = { {0, 0}, {uint32_t(window_width), uint32_t(window_height)} };
-
-		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-		vkCmdPushConstants(command_buffer, pipeline_layout[0], VK_SHADER_STAGE_VERTEX_BIT,
-		                   16 * sizeof(float), sizeof(uint32_t), &window_width);
-		vkCmdPushConstants(command_buffer, pipeline_layout[0], VK_SHADER_STAGE_VERTEX_BIT,
-		                   16 * sizeof(float) + sizeof(uint32_t), sizeof(uint32_t), &window_height);
-
-		draw::PresentUI();
-
-		VK_CHECK(vkEndCommandBuffer(command_buffer));
+		profiler::CpuPush("UIThread", cpu_begin);
 		run_threads[1] = false;
 		lk.unlock();
 		cvx[1].notify_one();
@@ -617,6 +826,7 @@ void UIThread()
 
 void Main3DThread()
 {
+	profiler::CpuThreadName("3d");
 	for(;;)
 	{
 
@@ -626,6 +836,7 @@ void Main3DThread()
 		{
 			return;
 		}
+		uint64_t cpu_begin = profiler::CpuNow();
 		VkCommandBufferInheritanceInfo cbii;
 		cbii.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
 		cbii.pNext = nullptr;
@@ -651,22 +862,27 @@ void Main3DThread()
 		MatrixMultiply(cam.mvp, cam.view);
 		vkCmdPushConstants(command_buffer, pipeline_layout[0], VK_SHADER_STAGE_VERTEX_BIT, 0, 16 * sizeof(float), &cam.mvp);
 
-		draw::CameraVectors();
-		basic_ent_t line;
-		line.pidx = 4;
-		vec3_t to;
-		vec3_t from;
-		vec3_t col;
-		col[0] = 1.0f;
-		col[1] = 0.0f;
-		col[2] = 0.0f;
-		Btof(rayFrom, from);
-		Btof(rayTo, to);
-		draw::Line(from, to, col, line);
-		//draw::Meshes();
-		draw::SkyDome();
+		{
+			GPU_SCOPE("3d");
+			draw::CameraVectors();
+			basic_ent_t line;
+			line.pidx = 4;
+			vec3_t to;
+			vec3_t from;
+			vec3_t col;
+			col[0] = 1.0f;
+			col[1] = 0.0f;
+			col[2] = 0.0f;
+			Btof(rayFrom, from);
+			Btof(rayTo, to);
+			draw::Line(from, to, col, line);
+			//runs beside StepPhysics, the entity arrays are read under scene_mutex.
+			cull_recorded = draw::Meshes();
+			draw::SkyDome();
+		}
 
 		VK_CHECK(vkEndCommandBuffer(command_buffer));
+		profiler::CpuPush("Main3DThread", cpu_begin);
 
 		run_threads[0] = false;
 		lk.unlock();
@@ -692,7 +908,7 @@ void PreDraw()
 
 	shaders::CompileShaders();
 	draw::InitUI();
-	draw::InitAtlasTexture();
+	font::Init();
 
 	render::CreatePipelineLayout();
 
@@ -703,8 +919,11 @@ void PreDraw()
 
 	//fov setup.
 	entity::InitCamera();
+	//the main and the 3d thread are busy while the pool runs.
+	jobs::SetThreads(int(std::thread::hardware_concurrency()) - 2);
 	entity::InitPhysics();
 	entity::InitMeshes();
+	gpucull::Init();
 	//entity::SetupWorldPlane(50.0f);
 
 	for(int i = 0; i<10; i++)
@@ -755,9 +974,11 @@ void PreDraw()
 
 	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submit_info.pNext = nullptr;
+	wait_semaphores[0] = AcquiredSemaphore;
+	wait_semaphores[1] = ComputeSemaphore;
 	submit_info.waitSemaphoreCount = 1;
-	submit_info.pWaitSemaphores = &AcquiredSemaphore;
-	submit_info.pWaitDstStageMask = &flags;
+	submit_info.pWaitSemaphores = &wait_semaphores[0];
+	submit_info.pWaitDstStageMask = &flags[0];
 	submit_info.commandBufferCount = 1;
 	submit_info.pCommandBuffers = &command_buffer;
 	submit_info.signalSemaphoreCount = 1;
@@ -797,17 +1018,10 @@ void WaitForWorkers()
 
 void DebugTimingInTitle()
 {
-	uint64_t queryResults[2];
-	VK_CHECK(vkGetQueryPoolResults(logical_device, queryPool, 0, ARRAYSIZE(queryResults),
-	                               sizeof(queryResults), queryResults, sizeof(queryResults[0]), VK_QUERY_RESULT_64_BIT));
-
-	double frameGpuBegin = double(queryResults[0]) * device_properties.limits.timestampPeriod * 1e-6;
-	double frameGpuEnd = double(queryResults[1]) * device_properties.limits.timestampPeriod * 1e-6;
-
 	double frameCpuEnd = glfwGetTime() * 1000;
 
 	frameCpuAvg = frameCpuAvg * 0.95 + (frameCpuEnd - (time1*1000)) * 0.05;
-	frameGpuAvg = frameGpuAvg * 0.95 + (frameGpuEnd - frameGpuBegin) * 0.05;
+	frameGpuAvg = frameGpuAvg * 0.95 + profiler::GpuFrameMs() * 0.05;
 
 	char title[256];
 	sprintf(title, "cpu: %.2f ms; gpu: %.2f ms; ", frameCpuAvg, frameGpuAvg);
@@ -816,6 +1030,7 @@ void DebugTimingInTitle()
 
 inline uint8_t Draw()
 {
+	CPU_SCOPE("Draw");
 	VkResult result;
 
 	vkResetFences(logical_device, 1, &Fence_one);
@@ -831,6 +1046,7 @@ inline uint8_t Draw()
 		return 0;
 	}
 
+	DrainInput();
 	processInput();
 	entity::UpdateCamera();
 
@@ -839,8 +1055,7 @@ inline uint8_t Draw()
 	ConsoleCvarCheck();
 
 #ifdef DEBUG
-	vkCmdResetQueryPool(command_buffer, queryPool, 0, 128);
-	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 0);
+	profiler::GpuBeginFrame(command_buffer);
 #endif
 
 	VkRect2D render_area = {};
@@ -854,9 +1069,19 @@ inline uint8_t Draw()
 
 	render::StartRenderPass(render_area, &clearColor[0], VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, 0, image_index);
 
+	if(draw::PrepareUI())
+	{
+		ui_valid = false;
+	}
+	entity::UpdateLod(); //reads last frame's cam.mvp, before Main3DThread rewrites it.
 	AwakeWorkers();
 	entity::StepPhysics();
 	WaitForWorkers();
+	font::Flush(); //glyphs the UI thread built this frame.
+	if(cull_recorded)
+	{
+		gpucull::Dispatch(cam.mvp); //the submit below waits for it.
+	}
 
 	control::SetCommandBuffer(current_cmd_buffer_index);
 	vkCmdExecuteCommands(command_buffer, 2, &scommand_buffers[0]);
@@ -867,10 +1092,12 @@ inline uint8_t Draw()
 	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
 	                     0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier_before_present);
 #ifdef DEBUG
-	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+	profiler::GpuEndFrame(command_buffer);
 #endif
 	VK_CHECK(vkEndCommandBuffer(command_buffer));
 
+	//also wait for async compute results, if any were submitted this frame.
+	submit_info.waitSemaphoreCount = control::ConsumeCompute() ? 2 : 1;
 	VK_CHECK(vkQueueSubmit(GraphicsQueue, 1, &submit_info, Fence_one));
 
 	control::ResetStagingBuffer();
@@ -879,6 +1106,7 @@ inline uint8_t Draw()
 	result = vkQueuePresentKHR(GraphicsQueue, &present_info);
 
 	vkWaitForFences(logical_device, 1, &Fence_one, VK_TRUE, UINT64_MAX);
+	control::CollectRetired();
 #ifdef DEBUG
 	DebugTimingInTitle();
 #endif
@@ -909,10 +1137,16 @@ void mainLoop()
 	int oldframecount = 0;
 	int frames = 0;
 
+	profiler::CpuThreadName("main");
 	while (!glfwWindowShouldClose(_window))
 	{
 		//char* a = new char[10000];
 		glfwPollEvents();
+		if(minimized)
+		{
+			glfwWaitEvents(); //nothing to present, sleep until restored.
+			continue;
+		}
 		time1 = glfwGetTime();
 		deltatime = time1 - time2;
 		realtime += deltatime;
@@ -957,6 +1191,7 @@ wait:
 			fatal("Critical Error! Abandon the ship.");
 			break;
 		}
+		profiler::CpuEndFrame();
 		framecount++;
 c:
 		if(deltatime < 0.02f)
@@ -969,9 +1204,14 @@ c:
 	//CLEANUP -----------------------------------
 	quit = true;
 	AwakeWorkers();
+	jobs::Shutdown();
 	VK_CHECK(vkDeviceWaitIdle(logical_device));
+	control::DestroyRetired();
 	vkDestroyQueryPool(logical_device, queryPool, allocators);
 	control::FreeCommandBuffers(NUM_COMMAND_BUFFERS);
+	control::DestroyCompute();
+	gpucull::Destroy();
+	draw::DestroyUI();
 	render::DestroyDepthBuffer();
 	control::DestroyCommandPool();
 	control::DestroyDynBuffers();
@@ -987,6 +1227,7 @@ c:
 	render::DestroyFramebuffers();
 	vkDestroyPipelineLayout(logical_device, pipeline_layout[0], allocators);
 	vkDestroyPipelineLayout(logical_device, pipeline_layout[1], allocators);
+	vkDestroyPipelineLayout(logical_device, pipeline_layout[2], allocators);
 	render::DestroyPipeLines();
 	render::DestroyRenderPasses();
 	shaders::DestroyShaders();
@@ -2,6 +2,10 @@
 #define __WINDOW_H__
 #include "startup.h"
 
+#define INPUT_QUEUE_SIZE 256 //must be a power of two.
+#define CONSOLE_LINES 512 //console history, oldest lines are overwritten.
+#define CONSOLE_LINE_LENGTH 128 //longer lines continue on the next one.
+
 extern GLFWwindow* _window;
 extern VkSwapchainKHR _swapchain;
 extern VkSwapchainKHR old_swapchain;
@@ -10,10 +14,12 @@ extern VkSemaphore ReadySemaphore;
 extern VkFence Fence_one;
 extern VkQueue GraphicsQueue;
 extern VkQueue ComputeQueue;
+extern VkQueue TransferQueue;
 extern int window_width;
 extern int window_height;
 extern uint32_t graphics_queue_family_index;
 extern uint32_t compute_queue_family_index;
+extern uint32_t transfer_queue_family_index;
 extern double time1;
 extern double y_wheel;
 extern double xm_norm;
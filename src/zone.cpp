@@ -304,6 +304,18 @@ void Q_strcat(char *dest, const char *src)
 	Q_strcpy (dest, src);
 }
 
+//FNV-1a, pass the previous result as hash to continue over several blocks.
+uint32_t Q_hash(const void *data, size_t size, uint32_t hash)
+{
+	const unsigned char *p = (const unsigned char *) data;
+	while (size--)
+	{
+		hash ^= *p++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 int Q_strcmp(const char *s1, const char *s2)
 {
 	while (1)
@@ -79,6 +79,7 @@ void Q_memset(void *dest, int fill, size_t count);
 size_t Q_sstrlen (const char* s) ;
 void Q_strcpy(char *dest, const char *src);
 void Q_strcat(char *dest, const char *src);
+uint32_t Q_hash(const void *data, size_t size, uint32_t hash = 2166136261u);
 
 __attribute__((noinline)) void stack_alloc(int size);
 void stack_clear(int size);
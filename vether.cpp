@@ -17,4 +17,8 @@
 #include "swapchain.cpp"
 #include "microui.cpp"
 #include "flog.cpp"
+#include "profiler.cpp"
+#include "font.cpp"
+#include "gpucull.cpp"
+#include "jobs.cpp"
 //